@@ -0,0 +1,389 @@
+/*
+    Binary descriptors (steered BRIEF, as in ORB) and Hamming matching
+
+    harris.cpp and shi_tomasi.cpp only draw the detected corners. Here each
+    corner gets a 256-bit descriptor: the results of 256 intensity
+    comparisons between pairs of pixels of a smoothed patch (Calonder et al.,
+    2010). The pairs are rotated by the orientation of the patch, given by
+    its intensity centroid (Rublee et al., 2011); the rotated patterns are
+    precomputed for 30 angles. Descriptors are stored as four 64-bit words,
+    so the Hamming distance of two descriptors is four XORs and popcounts.
+    The brute-force matcher splits the queries between threads and filters
+    the matches with a ratio test and a cross-check.
+*/
+
+#define cimg_use_png
+#include "CImg.h"
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>
+
+using namespace cimg_library;
+
+const int
+    PATCH_RADIUS = 15,  // Radius of the patch used for the orientation and the pairs
+    BORDER = 22,        // Keypoints closer to the border are dropped (rotated pairs stay inside)
+    NB_ANGLES = 30;     // Number of precomputed rotations of the pattern
+
+// Keypoint: position, detector response and orientation (radians).
+struct Keypoint
+{
+    float x, y, score, angle;
+};
+
+// 256-bit descriptor.
+struct Descriptor
+{
+    uint64_t bits[4];
+};
+
+// Match between a query and a train descriptor.
+struct Match
+{
+    int query, train, distance;
+};
+
+// Pairs of pixel offsets compared by the descriptor, for each precomputed angle.
+struct BriefPattern
+{
+    std::vector<int> offsets[NB_ANGLES]; // 4 values (x1, y1, x2, y2) per pair
+};
+
+/*
+  Corner response (Harris or Shi-Tomasi).
+  imgIn     : Input image
+  k         : Sensitivity parameter (Harris only)
+  shiTomasi : true for min(lambda1, lambda2), false for det - k * trace^2
+*/
+CImg<> CornerResponse(CImg<> &imgIn, float k, bool shiTomasi)
+{
+    CImg<> M = imgIn.get_structure_tensors(true);
+    CImg<>
+        Ixx = M.get_channel(0),
+        Ixy = M.get_channel(1),
+        Iyy = M.get_channel(2);
+
+    CImg<>
+        det = Ixx.get_mul(Iyy) - Ixy.get_sqr(),
+        trace = Ixx + Iyy;
+    if (!shiTomasi)
+        return det - k * trace.get_sqr();
+
+    CImg<> diff = (trace.get_sqr() - 4 * det).max(0.0f).sqrt();
+    return (trace - diff) / 2;
+}
+
+/*
+  The n strongest local maxima of a corner response, away from the border.
+  R : Corner response
+  n : Maximal number of keypoints
+*/
+std::vector<Keypoint> DetectKeypoints(CImg<> &R, int n)
+{
+    std::vector<Keypoint> keypoints;
+    if (n <= 0)
+        return keypoints;
+    CImg_3x3(I, float);
+    cimg_for3x3(R, x, y, 0, 0, I, float)
+    {
+        if (x < BORDER || y < BORDER || x >= R.width() - BORDER || y >= R.height() - BORDER || Icc <= 0)
+            continue;
+        if (Icc > Ipp && Icc > Icp && Icc > Inp &&
+            Icc > Ipc && Icc > Inc &&
+            Icc > Ipn && Icc > Icn && Icc > Inn)
+            keypoints.push_back({(float)x, (float)y, Icc, 0});
+    }
+    auto stronger = [](const Keypoint &a, const Keypoint &b) { return a.score > b.score; };
+    if ((int)keypoints.size() > n)
+    {
+        std::nth_element(keypoints.begin(), keypoints.begin() + n - 1, keypoints.end(), stronger);
+        keypoints.resize(n);
+    }
+    std::sort(keypoints.begin(), keypoints.end(), stronger);
+    return keypoints;
+}
+
+/*
+  Orientation of the keypoints, from the intensity centroid of a disc of
+  radius PATCH_RADIUS: angle = atan2(m01, m10).
+  img       : Smoothed image
+  keypoints : Keypoints, angle updated
+*/
+void ComputeOrientations(const CImg<> &img, std::vector<Keypoint> &keypoints)
+{
+    // Half width of each row of the disc.
+    int halfWidth[PATCH_RADIUS + 1];
+    for (int v = 0; v <= PATCH_RADIUS; ++v)
+        halfWidth[v] = (int)std::floor(std::sqrt((float)(PATCH_RADIUS * PATCH_RADIUS - v * v)));
+
+    for (Keypoint &kp : keypoints)
+    {
+        int x = (int)kp.x, y = (int)kp.y;
+        float m10 = 0, m01 = 0;
+        for (int v = -PATCH_RADIUS; v <= PATCH_RADIUS; ++v)
+        {
+            const float *row = img.data(x, y + v);
+            int hw = halfWidth[std::abs(v)];
+            float sum = 0;
+            for (int u = -hw; u <= hw; ++u)
+            {
+                m10 += u * row[u];
+                sum += row[u];
+            }
+            m01 += v * sum;
+        }
+        kp.angle = std::atan2(m01, m10);
+    }
+}
+
+/*
+  Random pattern of 256 pairs, drawn from an isotropic Gaussian (sigma = S/5
+  for a patch of size S = 31) with a fixed seed, and its rotations.
+  seed : Seed of the pattern
+*/
+BriefPattern MakeBriefPattern(unsigned int seed = 0)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> normal(0, (2 * PATCH_RADIUS + 1) / 5.0f);
+    auto draw = [&]()
+    {
+        return std::min(std::max(normal(rng), (float)-PATCH_RADIUS), (float)PATCH_RADIUS);
+    };
+    std::vector<float> pairs(4 * 256);
+    for (float &p : pairs)
+        p = draw();
+
+    BriefPattern pattern;
+    for (int a = 0; a < NB_ANGLES; ++a)
+    {
+        float
+            theta = 2 * (float)cimg::PI * a / NB_ANGLES,
+            c = std::cos(theta),
+            s = std::sin(theta);
+        std::vector<int> &offsets = pattern.offsets[a];
+        offsets.resize(4 * 256);
+        for (int i = 0; i < 2 * 256; ++i)
+        {
+            float px = pairs[2 * i], py = pairs[2 * i + 1];
+            offsets[2 * i] = (int)std::lround(c * px - s * py);
+            offsets[2 * i + 1] = (int)std::lround(s * px + c * py);
+        }
+    }
+    return pattern;
+}
+
+/*
+  Steered BRIEF descriptors.
+  img       : Smoothed image
+  keypoints : Keypoints, with their orientation
+  pattern   : Pattern of pairs
+  nbThreads : Number of threads
+*/
+std::vector<Descriptor> DescribeKeypoints(const CImg<> &img, const std::vector<Keypoint> &keypoints,
+                                          const BriefPattern &pattern, unsigned int nbThreads)
+{
+    std::vector<Descriptor> descriptors(keypoints.size());
+    int w = img.width();
+    auto describe = [&, w](int first, int last)
+    {
+        for (int k = first; k < last; ++k)
+        {
+            const Keypoint &kp = keypoints[k];
+            int a = (int)std::lround(kp.angle * NB_ANGLES / (2 * cimg::PI));
+            a = ((a % NB_ANGLES) + NB_ANGLES) % NB_ANGLES;
+            const int *o = pattern.offsets[a].data();
+            const float *center = img.data((int)kp.x, (int)kp.y);
+            Descriptor &d = descriptors[k];
+            for (int word = 0; word < 4; ++word)
+            {
+                uint64_t bits = 0;
+                for (int b = 0; b < 64; ++b, o += 4)
+                    bits |= (uint64_t)(center[o[0] + o[1] * w] < center[o[2] + o[3] * w]) << b;
+                d.bits[word] = bits;
+            }
+        }
+    };
+    int n = (int)keypoints.size();
+    nbThreads = std::max(1u, nbThreads);
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(describe, n * t / nbThreads, n * (t + 1) / nbThreads);
+    for (auto &wk : workers)
+        wk.join();
+    return descriptors;
+}
+
+inline int HammingDistance(const Descriptor &a, const Descriptor &b)
+{
+    return __builtin_popcountll(a.bits[0] ^ b.bits[0]) + __builtin_popcountll(a.bits[1] ^ b.bits[1]) +
+           __builtin_popcountll(a.bits[2] ^ b.bits[2]) + __builtin_popcountll(a.bits[3] ^ b.bits[3]);
+}
+
+/*
+  Nearest and second nearest train descriptor of each query, by brute force.
+  query, train : Descriptors
+  best, second : Output, best match and distance to the second best
+  nbThreads    : Number of threads (the queries are split into ranges)
+*/
+void NearestNeighbors(const std::vector<Descriptor> &query, const std::vector<Descriptor> &train,
+                      std::vector<Match> &best, std::vector<int> &second, unsigned int nbThreads)
+{
+    best.assign(query.size(), Match{-1, -1, 257});
+    second.assign(query.size(), 257);
+    auto search = [&](int first, int last)
+    {
+        for (int q = first; q < last; ++q)
+        {
+            int d1 = 257, d2 = 257, j1 = -1;
+            for (int t = 0; t < (int)train.size(); ++t)
+            {
+                int d = HammingDistance(query[q], train[t]);
+                if (d < d1)
+                {
+                    d2 = d1;
+                    d1 = d;
+                    j1 = t;
+                }
+                else if (d < d2)
+                    d2 = d;
+            }
+            best[q] = {q, j1, d1};
+            second[q] = d2;
+        }
+    };
+    int n = (int)query.size();
+    nbThreads = std::max(1u, nbThreads);
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(search, n * t / nbThreads, n * (t + 1) / nbThreads);
+    for (auto &wk : workers)
+        wk.join();
+}
+
+/*
+  Brute-force Hamming matching with filters.
+  query, train : Descriptors
+  ratio        : Ratio test, best < ratio * second best (1 to disable)
+  crossCheck   : Keep only the matches that are also the best for the train descriptor
+  maxDistance  : Maximal Hamming distance
+  nbThreads    : Number of threads
+*/
+std::vector<Match> MatchDescriptors(const std::vector<Descriptor> &query, const std::vector<Descriptor> &train,
+                                    float ratio, bool crossCheck, int maxDistance, unsigned int nbThreads)
+{
+    std::vector<Match> best, reverse;
+    std::vector<int> second, reverseSecond;
+    NearestNeighbors(query, train, best, second, nbThreads);
+    if (crossCheck)
+        NearestNeighbors(train, query, reverse, reverseSecond, nbThreads);
+
+    std::vector<Match> matches;
+    for (size_t q = 0; q < query.size(); ++q)
+    {
+        const Match &m = best[q];
+        if (m.train < 0 || m.distance > maxDistance || m.distance >= ratio * second[q])
+            continue;
+        if (crossCheck && reverse[m.train].train != (int)q)
+            continue;
+        matches.push_back(m);
+    }
+    return matches;
+}
+
+/*
+  Keypoints and descriptors of an image.
+  imgIn     : Input image (grey levels)
+  n         : Number of keypoints
+  pattern   : Pattern of pairs
+  nbThreads : Number of threads
+*/
+std::vector<Descriptor> DetectAndDescribe(CImg<> &imgIn, int n, const BriefPattern &pattern,
+                                          std::vector<Keypoint> &keypoints, unsigned int nbThreads)
+{
+    CImg<> R = CornerResponse(imgIn, 0.04f, true);
+    keypoints = DetectKeypoints(R, n);
+    CImg<> smooth = imgIn.get_blur(2.0f);
+    ComputeOrientations(smooth, keypoints);
+    return DescribeKeypoints(smooth, keypoints, pattern, nbThreads);
+}
+
+int main()
+{
+    CImg<> img1("../images/lighthouse.png");
+    img1.norm();
+
+    // Second view: rotation by 30 degrees around the center.
+    float angle = 30, cx = img1.width() / 2.0f, cy = img1.height() / 2.0f;
+    CImg<> img2 = img1.get_rotate(angle, cx, cy, 1, 1);
+
+    unsigned int nbThreads = std::max(1u, std::thread::hardware_concurrency());
+    BriefPattern pattern = MakeBriefPattern();
+    std::vector<Keypoint> kp1, kp2;
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<Descriptor> d1 = DetectAndDescribe(img1, 1000, pattern, kp1, nbThreads);
+    std::vector<Descriptor> d2 = DetectAndDescribe(img2, 1000, pattern, kp2, nbThreads);
+    auto t1 = std::chrono::steady_clock::now();
+    std::vector<Match> matches = MatchDescriptors(d1, d2, 0.8f, true, 64, nbThreads);
+    auto t2 = std::chrono::steady_clock::now();
+
+    // A match is correct if it agrees with the rotation within 3 pixels.
+    float
+        c = std::cos(angle * (float)cimg::PI / 180),
+        s = std::sin(angle * (float)cimg::PI / 180);
+    int nbCorrect = 0;
+    for (const Match &m : matches)
+    {
+        const Keypoint &p = kp1[m.query], &q = kp2[m.train];
+        float
+            ex = cx + c * (p.x - cx) - s * (p.y - cy),
+            ey = cy + s * (p.x - cx) + c * (p.y - cy);
+        nbCorrect += cimg::sqr(ex - q.x) + cimg::sqr(ey - q.y) < 9;
+    }
+    std::cout << "Keypoints: " << kp1.size() << " / " << kp2.size() << ", matches: " << matches.size()
+              << ", correct: " << nbCorrect << std::endl;
+    std::cout << "Detection and description: " << std::chrono::duration<double>(t1 - t0).count() * 1000
+              << " ms, matching: " << std::chrono::duration<double>(t2 - t1).count() * 1000 << " ms ("
+              << nbThreads << " threads)" << std::endl;
+
+    // Matcher throughput on random descriptors.
+    std::mt19937_64 rng(42);
+    std::vector<Descriptor> q(5000), t(5000);
+    for (auto &d : q)
+        for (auto &word : d.bits)
+            word = rng();
+    for (auto &d : t)
+        for (auto &word : d.bits)
+            word = rng();
+    t0 = std::chrono::steady_clock::now();
+    std::vector<Match> best;
+    std::vector<int> second;
+    NearestNeighbors(q, t, best, second, nbThreads);
+    t1 = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(t1 - t0).count();
+    std::cout << "5000 x 5000 brute force: " << elapsed * 1000 << " ms ("
+              << q.size() * t.size() / elapsed / 1e6 << " M distances/s)" << std::endl;
+
+    // Display of the correct matches, side by side.
+    CImg<unsigned char> imgOut = (img1, img2).get_append('x').normalize(0, 255).resize(-100, -100, 1, 3);
+    unsigned char green[] = {0, 255, 0}, red[] = {255, 0, 0};
+    for (const Match &m : matches)
+    {
+        const Keypoint &p = kp1[m.query], &q = kp2[m.train];
+        float
+            ex = cx + c * (p.x - cx) - s * (p.y - cy),
+            ey = cy + s * (p.x - cx) + c * (p.y - cy);
+        bool correct = cimg::sqr(ex - q.x) + cimg::sqr(ey - q.y) < 9;
+        imgOut.draw_line((int)p.x, (int)p.y, (int)q.x + img1.width(), (int)q.y, correct ? green : red);
+    }
+    imgOut.save("./results/lighthouse_brief_matches.png");
+
+    return 0;
+}
@@ -0,0 +1,423 @@
+/*
+    Histogram of Oriented Gradients (Dalal and Triggs, 2005)
+
+    The gradient of each row is computed once and turned into bins and
+    weights by the orientation kernel of tamura_directionality_fast.cpp
+    (unsigned angles, soft binning, votes weighted by the magnitude). Each
+    vote is then shared between the four nearest cell centers, which with
+    the soft binning gives the trilinear interpolation of Dalal and Triggs.
+    Blocks of 2 x 2 cells are normalized once for the whole image, and
+    stored contiguously, so that a detection window is a set of contiguous
+    runs of blocks: a linear classifier scores every window by dot products
+    over these runs, without copying or renormalizing the shared blocks.
+*/
+
+#define cimg_use_png
+#include "CImg.h"
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+using namespace cimg_library;
+
+// Parameters of the descriptor (sizes in pixels for the cells and the window, in cells for the blocks).
+struct HOGParams
+{
+    int cellSize, blockSize, nbBins, windowWidth, windowHeight;
+};
+
+// Normalized blocks of an image: block (bx, by) starts at data.data(0, bx, by).
+struct HOGBlocks
+{
+    int nbx, nby, blockDim;
+    CImg<> data; // blockDim x nbx x nby
+};
+
+// Parameters of an orientation histogram.
+struct OrientationBinning
+{
+    int nbBins;
+    bool signedAngles;  // Angles in [-pi, pi] if true, in [0, pi] otherwise
+    float minMagnitude; // Gradients below are ignored
+    bool weighted;      // Votes weighted by the magnitude (1 otherwise)
+    bool soft;          // Votes shared between the two nearest bin centers
+};
+
+/*
+  atan2 approximated by a polynomial on [0, 1] and symmetries, with an
+  error below 2e-5 rad. Both sides of each select are computed, so that the
+  function can be vectorized.
+*/
+inline float FastAtan2(float y, float x)
+{
+    const float PI = (float)cimg::PI;
+    float
+        ax = std::abs(x),
+        ay = std::abs(y),
+        a = std::min(ax, ay) / std::max(std::max(ax, ay), 1e-30f),
+        s = a * a,
+        r = (((((0.0208351f * s - 0.085133f) * s + 0.180141f) * s - 0.3302995f) * s + 0.999866f) * a),
+        r1 = PI / 2 - r;
+    r = ay > ax ? r1 : r;
+    float r2 = PI - r;
+    r = x < 0 ? r2 : r;
+    float r3 = -r;
+    return y < 0 ? r3 : r;
+}
+
+/*
+  Bin and weight of the gradients of a row, copied from
+  tamura_directionality_fast.cpp.
+  gx, gy  : Gradient
+  n       : Number of pixels
+  binning : Histogram parameters
+  bin     : Output, lower bin of each pixel
+  frac    : Output, part of the vote going to the next bin (circularly)
+  weight  : Output, vote of each pixel (0 for weak gradients)
+*/
+void OrientationBins(const float *gx, const float *gy, int n, const OrientationBinning &binning,
+                     int *bin, float *frac, float *weight)
+{
+    const float PI = (float)cimg::PI;
+    const int nbBins = binning.nbBins;
+    const float
+        scale = nbBins / (binning.signedAngles ? 2 * PI : PI),
+        offset = binning.signedAngles ? PI : 0, // Added to the positive angles
+        shift = binning.soft ? 0.5f : 0.0f,
+        soft = binning.soft ? 1.0f : 0.0f,
+        minMagnitude2 = binning.minMagnitude * binning.minMagnitude,
+        unit = binning.weighted ? 0.0f : 1.0f;
+    for (int i = 0; i < n; ++i)
+    {
+        float
+            m2 = gx[i] * gx[i] + gy[i] * gy[i],
+            a = FastAtan2(gy[i], gx[i]);
+        a += a < 0 ? PI : offset;
+
+        // Position in bins, relative to the bin centers for soft binning.
+        float t = a * scale - shift;
+        int b = (int)(t + 1) - 1;
+        frac[i] = soft * (t - b);
+        b = b < 0 ? b + nbBins : b;
+        bin[i] = b >= nbBins ? b - nbBins : b;
+
+        // Squared magnitude (square-rooted below) or 1.
+        weight[i] = m2 > minMagnitude2 ? m2 + unit * (1 - m2) : 0.0f;
+    }
+    if (binning.weighted)
+        for (int i = 0; i < n; ++i)
+            weight[i] = std::sqrt(weight[i]);
+}
+
+/*
+  Cell histograms, with trilinear interpolation.
+  imgIn     : Input image (first channel)
+  params    : Descriptor parameters
+  nbThreads : Number of threads (rows are split into bands)
+  Returns an nbBins x ncx x ncy image.
+*/
+CImg<> CellHistograms(const CImg<> &imgIn, const HOGParams &params, unsigned int nbThreads)
+{
+    int
+        w = imgIn.width(),
+        h = imgIn.height(),
+        cs = params.cellSize,
+        nb = params.nbBins,
+        ncx = w / cs,
+        ncy = h / cs,
+        stride = (ncx + 2) * nb; // Row of cells, with one cell of padding on each side
+    if (ncx == 0 || ncy == 0)
+        return CImg<>();
+    OrientationBinning binning = {nb, false, 0.0f, true, true};
+
+    // Left cell and interpolation weight of each column, relative to the cell centers.
+    std::vector<int> cellOfColumn(ncx * cs);
+    std::vector<float> fxOfColumn(ncx * cs);
+    for (int x = 0; x < ncx * cs; ++x)
+    {
+        float u = (x + 0.5f) / cs - 0.5f;
+        int c = (int)(u + 1) - 1;
+        cellOfColumn[x] = (c + 1) * nb;
+        fxOfColumn[x] = u - c;
+    }
+
+    // Each thread votes in its own padded grid of cells.
+    nbThreads = std::max(1u, std::min(nbThreads, (unsigned int)ncy));
+    std::vector<CImg<>> grids(nbThreads);
+    auto band = [&, w, h, cs, nb, ncx, stride](int y0, int y1, unsigned int t)
+    {
+        int n = ncx * cs;
+        CImg<> &grid = grids[t];
+        grid.assign(stride, ncy + 2, 1, 1, 0);
+        std::vector<float> gx(n), gy(n), frac(n), weight(n);
+        std::vector<int> bin(n);
+        for (int y = y0; y < y1; ++y)
+        {
+            // Centered gradient, with Neumann boundaries.
+            const float
+                *row = imgIn.data(0, y),
+                *prev = imgIn.data(0, std::max(0, y - 1)),
+                *next = imgIn.data(0, std::min(h - 1, y + 1));
+            for (int x = 1; x < n - 1; ++x)
+            {
+                gx[x] = (row[x + 1] - row[x - 1]) / 2;
+                gy[x] = (next[x] - prev[x]) / 2;
+            }
+            gx[0] = (row[1] - row[0]) / 2;
+            gy[0] = (next[0] - prev[0]) / 2;
+            gx[n - 1] = (row[std::min(n, w - 1)] - row[n - 2]) / 2;
+            gy[n - 1] = (next[n - 1] - prev[n - 1]) / 2;
+            OrientationBins(gx.data(), gy.data(), n, binning, bin.data(), frac.data(), weight.data());
+
+            // Spatial interpolation between the two rows and two columns of cells.
+            float v = (y + 0.5f) / cs - 0.5f;
+            int cy = (int)(v + 1) - 1;
+            float fy = v - cy;
+            float
+                *top = grid.data(0, cy + 1),
+                *bottom = top + stride;
+            for (int x = 0; x < n; ++x)
+            {
+                int
+                    c = cellOfColumn[x],
+                    b0 = bin[x],
+                    b1 = b0 + 1 == nb ? 0 : b0 + 1;
+                float
+                    fx = fxOfColumn[x],
+                    v1 = weight[x] * frac[x],
+                    v0 = weight[x] - v1,
+                    wt = 1 - fy;
+                float
+                    w00 = (1 - fx) * wt,
+                    w10 = fx * wt,
+                    w01 = (1 - fx) * fy,
+                    w11 = fx * fy;
+                top[c + b0] += v0 * w00;
+                top[c + b1] += v1 * w00;
+                top[c + nb + b0] += v0 * w10;
+                top[c + nb + b1] += v1 * w10;
+                bottom[c + b0] += v0 * w01;
+                bottom[c + b1] += v1 * w01;
+                bottom[c + nb + b0] += v0 * w11;
+                bottom[c + nb + b1] += v1 * w11;
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    int nbRows = ncy * cs;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(band, nbRows * t / nbThreads, nbRows * (t + 1) / nbThreads, t);
+    for (auto &wk : workers)
+        wk.join();
+
+    // Sum of the grids, without the padding cells.
+    CImg<> cells(nb, ncx, ncy, 1, 0);
+    for (const CImg<> &grid : grids)
+        for (int cy = 0; cy < ncy; ++cy)
+        {
+            const float *in = grid.data(nb, cy + 1);
+            float *out = cells.data(0, 0, cy);
+            for (int i = 0; i < ncx * nb; ++i)
+                out[i] += in[i];
+        }
+    return cells;
+}
+
+/*
+  Block normalization (L2-Hys) of all the blocks of the image.
+  cells     : Cell histograms (nbBins x ncx x ncy)
+  params    : Descriptor parameters
+  nbThreads : Number of threads
+*/
+HOGBlocks NormalizeBlocks(const CImg<> &cells, const HOGParams &params, unsigned int nbThreads)
+{
+    HOGBlocks blocks;
+    int
+        nb = params.nbBins,
+        bs = params.blockSize;
+    blocks.nbx = cells.height() - bs + 1;
+    blocks.nby = cells.depth() - bs + 1;
+    blocks.blockDim = bs * bs * nb;
+    if (blocks.nbx <= 0 || blocks.nby <= 0)
+    {
+        blocks.nbx = blocks.nby = 0;
+        return blocks;
+    }
+    blocks.data.assign(blocks.blockDim, blocks.nbx, blocks.nby);
+
+    auto normalize = [&, nb, bs](int by0, int by1)
+    {
+        const float eps = 1e-3f, clip = 0.2f;
+        for (int by = by0; by < by1; ++by)
+            for (int bx = 0; bx < blocks.nbx; ++bx)
+            {
+                float *out = blocks.data.data(0, bx, by);
+                for (int j = 0; j < bs; ++j)
+                    std::copy(cells.data(0, bx, by + j), cells.data(0, bx, by + j) + bs * nb, out + j * bs * nb);
+                for (int pass = 0; pass < 2; ++pass)
+                {
+                    float norm2 = 0;
+                    for (int i = 0; i < blocks.blockDim; ++i)
+                        norm2 += out[i] * out[i];
+                    float scale = 1 / std::sqrt(norm2 + eps * eps);
+                    for (int i = 0; i < blocks.blockDim; ++i)
+                        out[i] = std::min(out[i] * scale, pass == 0 ? clip : 1.0f);
+                }
+            }
+    };
+    nbThreads = std::max(1u, std::min(nbThreads, (unsigned int)blocks.nby));
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(normalize, blocks.nby * t / nbThreads, blocks.nby * (t + 1) / nbThreads);
+    for (auto &wk : workers)
+        wk.join();
+    return blocks;
+}
+
+/*
+  HOG of an image.
+  imgIn     : Input image (first channel)
+  params    : Descriptor parameters
+  nbThreads : Number of threads
+*/
+HOGBlocks HOG(const CImg<> &imgIn, const HOGParams &params, unsigned int nbThreads)
+{
+    return NormalizeBlocks(CellHistograms(imgIn, params, nbThreads), params, nbThreads);
+}
+
+/*
+  Descriptor of the window whose top-left block is (bx, by), copied into a
+  contiguous buffer, block row after block row.
+  blocks : Normalized blocks
+  params : Descriptor parameters
+  bx, by : Position of the window, in cells
+*/
+CImg<> WindowDescriptor(const HOGBlocks &blocks, const HOGParams &params, int bx, int by)
+{
+    int
+        wbx = params.windowWidth / params.cellSize - params.blockSize + 1,
+        wby = params.windowHeight / params.cellSize - params.blockSize + 1,
+        run = wbx * blocks.blockDim;
+    CImg<> descriptor(run * wby);
+    for (int j = 0; j < wby; ++j)
+        std::copy(blocks.data.data(0, bx, by + j), blocks.data.data(0, bx, by + j) + run, descriptor.data(j * run));
+    return descriptor;
+}
+
+/*
+  Scores of a linear classifier on every window (stride of one cell).
+  blocks    : Normalized blocks
+  params    : Descriptor parameters
+  weights   : Weights, in the layout of WindowDescriptor
+  bias      : Bias
+  nbThreads : Number of threads
+  Returns a map of the scores, one per window position.
+*/
+CImg<> LinearScores(const HOGBlocks &blocks, const HOGParams &params, const CImg<> &weights, float bias,
+                    unsigned int nbThreads)
+{
+    int
+        wbx = params.windowWidth / params.cellSize - params.blockSize + 1,
+        wby = params.windowHeight / params.cellSize - params.blockSize + 1,
+        nwx = blocks.nbx - wbx + 1,
+        nwy = blocks.nby - wby + 1,
+        run = wbx * blocks.blockDim;
+    if (nwx <= 0 || nwy <= 0)
+        return CImg<>();
+    CImg<> scores(nwx, nwy);
+
+    auto score = [&, wby, nwx, run](int y0, int y1)
+    {
+        for (int y = y0; y < y1; ++y)
+            for (int x = 0; x < nwx; ++x)
+            {
+                // The window covers wby runs of contiguous blocks.
+                float s = bias;
+                for (int j = 0; j < wby; ++j)
+                {
+                    const float
+                        *d = blocks.data.data(0, x, y + j),
+                        *wj = weights.data(j * run);
+                    // Independent partial sums, so that the loop vectorizes
+                    // without reassociating float additions.
+                    float dot[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+                    int i = 0;
+                    for (; i + 8 <= run; i += 8)
+                        for (int k = 0; k < 8; ++k)
+                            dot[k] += d[i + k] * wj[i + k];
+                    for (; i < run; ++i)
+                        dot[0] += d[i] * wj[i];
+                    for (int k = 0; k < 8; ++k)
+                        s += dot[k];
+                }
+                scores(x, y) = s;
+            }
+    };
+    nbThreads = std::max(1u, std::min(nbThreads, (unsigned int)nwy));
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(score, nwy * t / nbThreads, nwy * (t + 1) / nbThreads);
+    for (auto &wk : workers)
+        wk.join();
+    return scores;
+}
+
+int main()
+{
+    CImg<> imgIn("../images/street.png");
+    imgIn.norm().resize(1920, 1080, 1, 1, 3);
+
+    HOGParams params = {8, 2, 9, 64, 128};
+    unsigned int nbThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Average over a few frames.
+    const int nbFrames = 10;
+    double timeCells = 0, timeBlocks = 0, timeScores = 0;
+    HOGBlocks blocks;
+    CImg<> scores;
+
+    // Random linear model, in place of a trained one.
+    int dim = (params.windowWidth / params.cellSize - params.blockSize + 1) *
+              (params.windowHeight / params.cellSize - params.blockSize + 1) *
+              params.blockSize * params.blockSize * params.nbBins;
+    CImg<> weights(dim);
+    std::mt19937 rng(42);
+    std::normal_distribution<float> normal(0, 0.01f);
+    cimg_forX(weights, i) weights(i) = normal(rng);
+
+    for (int f = 0; f < nbFrames; ++f)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        CImg<> cells = CellHistograms(imgIn, params, nbThreads);
+        auto t1 = std::chrono::steady_clock::now();
+        blocks = NormalizeBlocks(cells, params, nbThreads);
+        auto t2 = std::chrono::steady_clock::now();
+        scores = LinearScores(blocks, params, weights, 0, nbThreads);
+        auto t3 = std::chrono::steady_clock::now();
+        timeCells += std::chrono::duration<double>(t1 - t0).count();
+        timeBlocks += std::chrono::duration<double>(t2 - t1).count();
+        timeScores += std::chrono::duration<double>(t3 - t2).count();
+    }
+    timeCells /= nbFrames;
+    timeBlocks /= nbFrames;
+    timeScores /= nbFrames;
+
+    std::cout << "Blocks: " << blocks.nbx << " x " << blocks.nby << " (" << blocks.blockDim
+              << " values each), window descriptor: " << dim << " values" << std::endl;
+    std::cout << "Cells: " << timeCells * 1000 << " ms, blocks: " << timeBlocks * 1000
+              << " ms (" << 1 / (timeCells + timeBlocks) << " frames/s, " << nbThreads << " threads)" << std::endl;
+    std::cout << "Scores of " << scores.size() << " windows: " << timeScores * 1000 << " ms" << std::endl;
+
+    // The score of a window is the dot product with its copied descriptor.
+    CImg<> descriptor = WindowDescriptor(blocks, params, 100, 50);
+    std::cout << "Window (100, 50): score " << scores(100, 50) << ", dot product "
+              << descriptor.dot(weights) << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,199 @@
+/*
+    Circle detection using the Hough transform (radius-sliced accumulator)
+
+    hough_circle.cpp allocates the whole W x H x (Rmax - Rmin) accumulator.
+    Here the radii are processed one slice at a time: each radius votes in a
+    2D center accumulator, and only three consecutive slices are kept alive
+    for the 3D non-maximum suppression. The radius range is split among
+    threads, each thread streaming through its own slices.
+*/
+
+#define cimg_use_png
+#include "CImg.h"
+
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+using namespace cimg_library;
+
+// Detected circle.
+struct Circle
+{
+    int x, y, r;
+    float score;
+};
+
+// Edge pixel and its unit gradient direction.
+struct EdgePoint
+{
+    int x, y;
+    float ux, uy;
+};
+
+/*
+  Edge pixels, selected once for all the radii.
+  imgIn : Input image
+  thr   : Threshold on the gradient norm, relative to its maximum
+*/
+std::vector<EdgePoint> SelectEdgePoints(CImg<> &imgIn, float thr)
+{
+    CImgList<> grad = imgIn.get_gradient();
+    cimglist_for(grad, l)
+        grad[l].blur(2.0f);
+    CImg<> norm = (grad[0].get_sqr() + grad[1].get_sqr()).sqrt();
+    float th = thr * norm.max();
+
+    std::vector<EdgePoint> points;
+    cimg_forXY(norm, x, y) if (norm(x, y) > th)
+        points.push_back({x, y, grad[0](x, y) / norm(x, y), grad[1](x, y) / norm(x, y)});
+    return points;
+}
+
+/*
+  Center accumulator of one radius. Each edge point votes for the two
+  candidate centers at distance r along its gradient. The votes are divided
+  by the circumference, so that the score is the fraction of the circle
+  supported by edge points, comparable across radii.
+  points : Edge points
+  r      : Radius
+  acc    : Accumulator (W x H), overwritten
+*/
+void VoteRadius(const std::vector<EdgePoint> &points, int r, CImg<> &acc)
+{
+    acc.fill(0);
+    float weight = 1.0f / (2 * (float)cimg::PI * r);
+    for (const EdgePoint &p : points)
+        for (int s = -1; s <= 1; s += 2)
+        {
+            int
+                xc = (int)std::floor(p.x + s * r * p.ux + 0.5f),
+                yc = (int)std::floor(p.y + s * r * p.uy + 0.5f);
+            if (xc >= 0 && xc < acc.width() && yc >= 0 && yc < acc.height())
+                acc(xc, yc) += weight;
+        }
+    acc.blur(1.0f);
+}
+
+/*
+  Local maxima of the slice cur in its 3x3x3 neighborhood (prev and next
+  are the slices of radii r - 1 and r + 1, empty at the ends of the range).
+*/
+void SlicePeaks(const CImg<> &prev, const CImg<> &cur, const CImg<> &next,
+                int r, float thr, std::vector<Circle> &circles)
+{
+    cimg_for_insideXY(cur, x, y, 1)
+    {
+        float value = cur(x, y);
+        if (value < thr)
+            continue;
+        bool ismax = true;
+        for (int dy = -1; dy <= 1 && ismax; ++dy)
+            for (int dx = -1; dx <= 1 && ismax; ++dx)
+            {
+                if ((dx || dy) && cur(x + dx, y + dy) > value)
+                    ismax = false;
+                if ((!prev.is_empty() && prev(x + dx, y + dy) > value) ||
+                    (!next.is_empty() && next(x + dx, y + dy) >= value))
+                    ismax = false;
+            }
+        if (ismax)
+            circles.push_back({x, y, r, value});
+    }
+}
+
+/*
+  Circle detection using the Hough transform
+  imgIn      : Input image
+  Rmin, Rmax : Radius range, with 1 <= Rmin <= Rmax
+  thr        : Minimal (blurred) fraction of the circle covered by edge points
+  nbThreads  : Number of threads
+*/
+std::vector<Circle> HoughCircles(CImg<> &imgIn, int Rmin, int Rmax, float thr, unsigned int nbThreads)
+{
+    if (Rmin < 1 || Rmax < Rmin)
+        throw CImgArgumentException("HoughCircles(): invalid radius range [%d, %d], expected 1 <= Rmin <= Rmax.",
+                                    Rmin, Rmax);
+    std::vector<EdgePoint> points = SelectEdgePoints(imgIn, 0.2f);
+    int nbRadii = Rmax - Rmin + 1;
+    nbThreads = std::max(1u, std::min(nbThreads, (unsigned int)nbRadii));
+
+    // Each thread streams through its own radius range, keeping three slices.
+    std::vector<std::vector<Circle>> partial(nbThreads);
+    auto detect = [&](unsigned int n)
+    {
+        int
+            rFirst = Rmin + nbRadii * n / nbThreads,
+            rLast = Rmin + nbRadii * (n + 1) / nbThreads - 1;
+        CImg<> prev, cur(imgIn.width(), imgIn.height()), next(imgIn.width(), imgIn.height());
+        VoteRadius(points, rFirst, cur);
+        if (rFirst > Rmin)
+        {
+            prev.assign(imgIn.width(), imgIn.height());
+            VoteRadius(points, rFirst - 1, prev);
+        }
+        for (int r = rFirst; r <= rLast; ++r)
+        {
+            if (r < Rmax)
+                VoteRadius(points, r + 1, next);
+            else
+                next.assign();
+            SlicePeaks(prev, cur, next, r, thr, partial[n]);
+            // Rotate the slices, recycling the buffer of prev.
+            prev.swap(cur);
+            cur.swap(next);
+            if (next.is_empty())
+                next.assign(imgIn.width(), imgIn.height());
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int n = 0; n < nbThreads; ++n)
+        workers.emplace_back(detect, n);
+    for (auto &w : workers)
+        w.join();
+
+    // Greedy deduplication: a circle is dropped if its center lies inside a stronger one.
+    std::vector<Circle> candidates, circles;
+    for (auto &c : partial)
+        candidates.insert(candidates.end(), c.begin(), c.end());
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Circle &a, const Circle &b) { return a.score > b.score; });
+    for (const Circle &c : candidates)
+    {
+        bool duplicate = false;
+        for (const Circle &d : circles)
+            duplicate = duplicate || cimg::sqr(c.x - d.x) + cimg::sqr(c.y - d.y) < d.r * d.r;
+        if (!duplicate)
+            circles.push_back(c);
+    }
+    return circles;
+}
+
+int main()
+{
+    CImg<> img("../images/coins.png");
+    img.norm().blur(0.75f).threshold(img.median() + 30).blur_median(5).resize(256, 256 * img.height() / img.width());
+
+    // Hough transform
+    int Rmin = 15, Rmax = 35;
+    std::vector<Circle> circles = HoughCircles(img, Rmin, Rmax, 0.12f, std::thread::hardware_concurrency());
+
+    CImg<> imgOut(img.width(), img.height(), 1, 3, 0);
+    unsigned char col1[3] = {255, 255, 0};
+    for (const Circle &c : circles)
+    {
+        std::cout << "Circle (" << c.x << ", " << c.y << "), r = " << c.r << ", score = " << c.score << std::endl;
+        imgOut.draw_circle(c.x, c.y, c.r, col1, 1.0f, ~0U);
+    }
+    std::cout << "Accumulator memory: " << 3 * img.width() * img.height() * sizeof(float) << " bytes per thread"
+              << " (dense volume: " << (size_t)img.width() * img.height() * (Rmax - Rmin + 1) * sizeof(float)
+              << " bytes)" << std::endl;
+
+    // Save result
+    imgOut.normalize(0, 255).save("./results/coins_hough_circle_sparse.png");
+
+    return 0;
+}
@@ -0,0 +1,468 @@
+/*
+    Line detection using the Hough transform (sparse voting)
+
+    Compared to hough.cpp, the edge pixels are first selected into a compact
+    list by thresholding the gradient norm, the votes use precomputed sin/cos
+    tables and are cast in parallel into per-thread accumulators, and the
+    peaks are extracted with a single non-maximum suppression pass.
+    The progressive probabilistic mode (Matas, Galambos and Kittler, 2000)
+    returns line segments instead of infinite lines.
+*/
+
+#define cimg_use_png
+#include "CImg.h"
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+using namespace cimg_library;
+
+// Edge pixel, with coordinates relative to the image center.
+struct EdgePoint
+{
+    float x, y, weight;
+    int thetaBin; // Bin of the gradient orientation
+};
+
+// Detected line: x cos(theta) + y sin(theta) = rho (origin at the image center).
+struct HoughLine
+{
+    float rho, theta, votes;
+};
+
+// Detected segment, in pixel coordinates.
+struct HoughSegment
+{
+    int x0, y0, x1, y1;
+};
+
+/*
+  Edge point selection.
+  imgIn   : Input image
+  nbTheta : Number of orientation bins of the accumulator
+  thr     : Threshold on the gradient norm, relative to its maximum
+  thin    : Keep only the local maxima of the norm along the gradient
+*/
+std::vector<EdgePoint> SelectEdgePoints(CImg<> &imgIn, int nbTheta, float thr, bool thin = false)
+{
+    // Gradient and smoothing (of the luminance for color images).
+    CImgList<> grad = (imgIn.spectrum() > 1 ? imgIn.get_norm() : imgIn).get_gradient();
+    cimglist_for(grad, l)
+        grad[l].blur(1.5f);
+    CImg<> norm = (grad[0].get_sqr() + grad[1].get_sqr()).sqrt();
+    float th = thr * norm.max();
+
+    float
+        cx = imgIn.width() / 2.0f,
+        cy = imgIn.height() / 2.0f;
+    std::vector<EdgePoint> points;
+    cimg_forXY(norm, x, y)
+    {
+        if (norm(x, y) <= th)
+            continue;
+        // Normal orientation, folded into [0, pi).
+        float theta = std::atan2(grad[1](x, y), grad[0](x, y));
+        if (theta < 0)
+            theta += (float)cimg::PI;
+        if (thin)
+        {
+            // Neighbors along the gradient, quantized to 45 degrees.
+            int
+                q = (int)(theta * 4 / cimg::PI + 0.5f) % 4,
+                ox = q == 2 ? 0 : q == 3 ? -1 : 1,
+                oy = q == 0 ? 0 : 1;
+            if (norm(x, y) < norm.atXY(x + ox, y + oy) || norm(x, y) < norm.atXY(x - ox, y - oy))
+                continue;
+        }
+        int t = (int)(theta * nbTheta / cimg::PI) % nbTheta;
+        points.push_back({x - cx, y - cy, norm(x, y), t});
+    }
+    return points;
+}
+
+/*
+  Trigonometric tables, scaled to rho bins: the rho bin of (x, y) at the
+  orientation bin t is (int)(x * cosTable[t] + y * sinTable[t] + offset).
+  nbTheta : Number of orientation bins
+  nbRho   : Number of distance bins
+  rhomax  : Maximal distance to the image center
+  Returns the offset.
+*/
+float TrigTables(int nbTheta, int nbRho, float rhomax,
+                 std::vector<float> &cosTable, std::vector<float> &sinTable)
+{
+    float scale = (nbRho - 1) / (2 * rhomax);
+    cosTable.resize(nbTheta);
+    sinTable.resize(nbTheta);
+    for (int t = 0; t < nbTheta; ++t)
+    {
+        cosTable[t] = std::cos((float)cimg::PI * t / nbTheta) * scale;
+        sinTable[t] = std::sin((float)cimg::PI * t / nbTheta) * scale;
+    }
+    return rhomax * scale + 0.5f;
+}
+
+/*
+  Hough accumulator of a list of edge points.
+  Each point votes in the orientation bins within thetaSpread of its gradient
+  orientation (thetaSpread >= nbTheta / 2 gives the classical full sinusoid).
+  The accumulator is indexed by (theta, rho), theta in [0, pi) and
+  rho in [-rhomax, rhomax].
+  points      : Edge points
+  nbTheta     : Number of orientation bins
+  nbRho       : Number of distance bins
+  rhomax      : Maximal distance to the image center
+  thetaSpread : Half width of the voting window (in bins)
+  nbThreads   : Number of threads
+*/
+CImg<> HoughVote(const std::vector<EdgePoint> &points, int nbTheta, int nbRho, float rhomax,
+                 int thetaSpread, unsigned int nbThreads)
+{
+    std::vector<float> cosTable, sinTable;
+    float offset = TrigTables(nbTheta, nbRho, rhomax, cosTable, sinTable);
+    int nbVotes = std::min(2 * thetaSpread + 1, nbTheta);
+
+    // One accumulator per thread, each thread votes for a slice of the points.
+    nbThreads = std::max(1u, nbThreads);
+    std::vector<CImg<>> partial(nbThreads);
+    auto vote = [&](unsigned int n)
+    {
+        CImg<> &acc = partial[n];
+        acc.assign(nbTheta, nbRho, 1, 1, 0);
+        size_t
+            first = points.size() * n / nbThreads,
+            last = points.size() * (n + 1) / nbThreads;
+        for (size_t i = first; i < last; ++i)
+        {
+            const EdgePoint &p = points[i];
+            int t = p.thetaBin - nbVotes / 2;
+            t += t < 0 ? nbTheta : 0;
+            for (int v = 0; v < nbVotes; ++v, ++t)
+            {
+                if (t == nbTheta)
+                    t = 0;
+                int r = (int)(p.x * cosTable[t] + p.y * sinTable[t] + offset);
+                acc(t, r) += p.weight;
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int n = 0; n < nbThreads; ++n)
+        workers.emplace_back(vote, n);
+    for (auto &w : workers)
+        w.join();
+
+    // Reduction.
+    for (unsigned int n = 1; n < nbThreads; ++n)
+        partial[0] += partial[n];
+    return partial[0];
+}
+
+/*
+  Peak extraction by non-maximum suppression, in a single pass.
+  The theta axis is periodic: (theta + pi, rho) is the same line as
+  (theta, -rho), so the neighborhood wraps around with a mirrored rho.
+  acc    : Accumulator (theta, rho)
+  th     : Threshold
+  wsize  : Half size of the neighborhood
+  rhomax : Maximal distance to the image center
+*/
+std::vector<HoughLine> HoughPeaks(CImg<> &acc, float th, int wsize, float rhomax)
+{
+    int nbTheta = acc.width(), nbRho = acc.height();
+    std::vector<HoughLine> lines;
+    cimg_forXY(acc, t, r)
+    {
+        float value = acc(t, r);
+        if (value < th)
+            continue;
+        bool ismax = true;
+        for (int dr = -wsize; dr <= wsize && ismax; ++dr)
+            for (int dt = -wsize; dt <= wsize && ismax; ++dt)
+            {
+                int nt = t + dt, nr = r + dr;
+                if (nt < 0 || nt >= nbTheta)
+                {
+                    nt += nt < 0 ? nbTheta : -nbTheta;
+                    nr = nbRho - 1 - nr;
+                }
+                if (nr < 0 || nr >= nbRho || (!dt && !dr))
+                    continue;
+                // Ties are broken by position so that a plateau gives one peak.
+                float v = acc(nt, nr);
+                ismax = v < value || (v == value && (dr > 0 || (!dr && dt > 0)));
+            }
+        if (ismax)
+            lines.push_back({r * 2 * rhomax / (nbRho - 1) - rhomax,
+                             t * (float)cimg::PI / nbTheta, value});
+    }
+    std::sort(lines.begin(), lines.end(),
+              [](const HoughLine &a, const HoughLine &b) { return a.votes > b.votes; });
+    return lines;
+}
+
+/*
+  Line detection using the Hough transform
+  imgIn   : Input image
+  lines   : Detected lines
+  nbTheta : Number of orientation bins
+  nbRho   : Number of distance bins
+  thr     : Accumulator threshold (relative to the log of its maximum)
+*/
+CImg<> HoughLines(CImg<> &imgIn, std::vector<HoughLine> &lines, int nbTheta, int nbRho, float thr)
+{
+    int
+        wx = imgIn.width(),
+        wy = imgIn.height();
+    float rhomax = std::sqrt((float)(wx * wx + wy * wy)) / 2;
+
+    std::vector<EdgePoint> points = SelectEdgePoints(imgIn, nbTheta, 0.1f);
+    CImg<> acc = HoughVote(points, nbTheta, nbRho, rhomax, 0, std::thread::hardware_concurrency());
+
+    // Smoothing and log transform of the accumulator.
+    acc.blur(0.5f);
+    cimg_for(acc, ptr, float)
+        *ptr = std::log(1 + *ptr);
+    lines = HoughPeaks(acc, thr * acc.max(), 4, rhomax);
+
+    // Line display.
+    CImg<> imgOut(imgIn);
+    unsigned char col1[3] = {255, 255, 0};
+    for (const HoughLine &l : lines)
+    {
+        float
+            c = std::cos(l.theta),
+            s = std::sin(l.theta),
+            x = wx / 2 + l.rho * c,
+            y = wy / 2 + l.rho * s;
+        int
+            x0 = (int)(x + 1000 * s),
+            y0 = (int)(y - 1000 * c),
+            x1 = (int)(x - 1000 * s),
+            y1 = (int)(y + 1000 * c);
+        imgOut.draw_line(x0, y0, x1, y1, col1, 1.0f).draw_line(x0 + 1, y0, x1 + 1, y1, col1, 1.0f).draw_line(x0, y0 + 1, x1, y1 + 1, col1, 1.0f);
+    }
+    return imgOut;
+}
+
+/*
+  Progressive probabilistic Hough transform.
+  Edge points are drawn in random order and vote (unweighted, full sinusoid)
+  in the same (theta, rho) accumulator as HoughVote. As soon as one of the
+  bins of the current point reaches minVotes, the corresponding line is
+  followed from the point in both directions, bridging gaps of at most
+  maxGap pixels. The edge pixels of the segment (within halfWidth pixels of
+  the line) are removed from the pool, and their votes are withdrawn from the
+  accumulator, so that the remaining points do not vote for it again.
+  Points never drawn do not vote at all, which is where the savings are.
+  imgIn     : Input image
+  points    : Edge points (see SelectEdgePoints)
+  nbTheta   : Number of orientation bins
+  nbRho     : Number of distance bins
+  minVotes  : Vote threshold of a line
+  minLength : Minimal length of a segment
+  maxGap    : Maximal gap on a segment
+  halfWidth : Half width of the band removed around a segment
+  nbVoted   : Number of points that have voted
+  seed      : Seed of the random order
+*/
+std::vector<HoughSegment> HoughProbabilistic(CImg<> &imgIn, const std::vector<EdgePoint> &points,
+                                             int nbTheta, int nbRho, int minVotes,
+                                             int minLength, int maxGap, int halfWidth,
+                                             size_t &nbVoted, unsigned int seed = 0)
+{
+    int
+        wx = imgIn.width(),
+        wy = imgIn.height();
+    float
+        cx = wx / 2.0f,
+        cy = wy / 2.0f,
+        rhomax = std::sqrt((float)(wx * wx + wy * wy)) / 2;
+    std::vector<float> cosTable, sinTable;
+    float offset = TrigTables(nbTheta, nbRho, rhomax, cosTable, sinTable);
+
+    // Edge mask: 0 = no edge, 1 = edge in the pool, 2 = edge that has voted.
+    CImg<unsigned char> mask(wx, wy, 1, 1, 0);
+    std::vector<int> order(points.size());
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        mask((int)(points[i].x + cx), (int)(points[i].y + cy)) = 1;
+        order[i] = (int)i;
+    }
+    std::mt19937 rng(seed);
+    std::shuffle(order.begin(), order.end(), rng);
+
+    CImg<int> acc(nbTheta, nbRho, 1, 1, 0);
+    auto vote = [&](int x, int y, int delta)
+    {
+        float X = x - cx, Y = y - cy;
+        for (int t = 0; t < nbTheta; ++t)
+            acc(t, (int)(X * cosTable[t] + Y * sinTable[t] + offset)) += delta;
+    };
+
+    std::vector<HoughSegment> segments;
+    nbVoted = 0;
+    for (int i : order)
+    {
+        int
+            x = (int)(points[i].x + cx),
+            y = (int)(points[i].y + cy);
+        // Already removed with a previous segment.
+        if (mask(x, y) != 1)
+            continue;
+
+        // Vote, and keep the best bin of the current point.
+        float X = x - cx, Y = y - cy;
+        int bestT = 0, bestVotes = 0;
+        for (int t = 0; t < nbTheta; ++t)
+        {
+            int &v = acc(t, (int)(X * cosTable[t] + Y * sinTable[t] + offset));
+            if (++v > bestVotes)
+            {
+                bestVotes = v;
+                bestT = t;
+            }
+        }
+        mask(x, y) = 2;
+        ++nbVoted;
+        if (bestVotes < minVotes)
+            continue;
+
+        // Direction of the line, stepping one pixel along the major axis.
+        float
+            theta = bestT * (float)cimg::PI / nbTheta,
+            dx = -std::sin(theta),
+            dy = std::cos(theta);
+        bool xMajor = std::abs(dx) > std::abs(dy);
+        float norm = xMajor ? std::abs(dx) : std::abs(dy);
+        dx /= norm;
+        dy /= norm;
+
+        // Is there an edge pixel across the line at (px, py)?
+        auto hasEdge = [&](int px, int py)
+        {
+            for (int w = -halfWidth; w <= halfWidth; ++w)
+            {
+                int qx = xMajor ? px : px + w, qy = xMajor ? py + w : py;
+                if (qx >= 0 && qx < wx && qy >= 0 && qy < wy && mask(qx, qy))
+                    return true;
+            }
+            return false;
+        };
+
+        // Walk in both directions to find the end points.
+        int end[2][2] = {{x, y}, {x, y}};
+        for (int k = 0; k < 2; ++k)
+        {
+            float
+                sx = k ? -dx : dx,
+                sy = k ? -dy : dy,
+                fx = x + 0.5f,
+                fy = y + 0.5f;
+            for (int gap = 0; gap <= maxGap;)
+            {
+                fx += sx;
+                fy += sy;
+                int px = (int)std::floor(fx), py = (int)std::floor(fy);
+                if (px < 0 || px >= wx || py < 0 || py >= wy)
+                    break;
+                if (hasEdge(px, py))
+                {
+                    gap = 0;
+                    end[k][0] = px;
+                    end[k][1] = py;
+                }
+                else
+                    ++gap;
+            }
+        }
+        bool longEnough = std::max(std::abs(end[0][0] - end[1][0]), std::abs(end[0][1] - end[1][1])) >= minLength;
+
+        // Remove the points of the segment from the pool. Their votes are
+        // withdrawn only if the segment is long enough to be kept.
+        int nbSteps = std::max(std::abs(end[0][0] - end[1][0]), std::abs(end[0][1] - end[1][1]));
+        float fx = end[1][0] + 0.5f, fy = end[1][1] + 0.5f;
+        for (int step = 0; step <= nbSteps; ++step, fx += dx, fy += dy)
+        {
+            int px = (int)std::floor(fx), py = (int)std::floor(fy);
+            for (int w = -halfWidth; w <= halfWidth; ++w)
+            {
+                int qx = xMajor ? px : px + w, qy = xMajor ? py + w : py;
+                if (qx < 0 || qx >= wx || qy < 0 || qy >= wy || !mask(qx, qy))
+                    continue;
+                if (longEnough && mask(qx, qy) == 2)
+                    vote(qx, qy, -1);
+                mask(qx, qy) = 0;
+            }
+        }
+        if (longEnough)
+            segments.push_back({end[1][0], end[1][1], end[0][0], end[0][1]});
+    }
+    return segments;
+}
+
+int main()
+{
+    CImg<> img("../images/road.png");
+
+    // Hough transform
+    float thr = 0.9f;
+    std::vector<HoughLine> lines;
+    CImg<> imgOut = HoughLines(img, lines, 360, 400, thr);
+    std::cout << "Detected lines: " << lines.size() << std::endl;
+    std::string filename = "./results/road_hough_lines_0." + std::to_string((int)(thr * 100)) + ".png";
+    imgOut.normalize(0, 255).save(filename.c_str());
+
+    // Voting throughput on a 4x upscaled image, with the full sinusoid.
+    CImg<> big = img.get_resize(img.width() * 4, img.height() * 4, 1, -100, 3);
+    float rhomax = std::sqrt((float)(big.width() * big.width() + big.height() * big.height())) / 2;
+    std::vector<EdgePoint> points = SelectEdgePoints(big, 360, 0.1f);
+    unsigned int nbThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (int spread : {0, 180})
+    {
+        auto start = std::chrono::steady_clock::now();
+        CImg<> acc = HoughVote(points, 360, 1000, rhomax, spread, nbThreads);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Voting (" << points.size() << " edge points, " << std::min(2 * spread + 1, 360)
+                  << " orientations each, " << nbThreads << " threads): "
+                  << elapsed.count() * 1000 << " ms, "
+                  << points.size() / elapsed.count() << " edge points/s" << std::endl;
+    }
+
+    // Progressive probabilistic Hough transform: line segments.
+    std::vector<EdgePoint> edges = SelectEdgePoints(img, 360, 0.2f, true);
+    size_t nbVoted = 0;
+    std::vector<HoughSegment> segments = HoughProbabilistic(img, edges, 360, 400, 50, 60, 5, 1, nbVoted);
+    std::cout << "Detected segments: " << segments.size() << " (" << nbVoted << " of "
+              << edges.size() << " edge points voted)" << std::endl;
+    CImg<> imgSeg(img);
+    unsigned char col1[3] = {255, 255, 0};
+    for (const HoughSegment &sg : segments)
+        imgSeg.draw_line(sg.x0, sg.y0, sg.x1, sg.y1, col1, 1.0f).draw_line(sg.x0 + 1, sg.y0, sg.x1 + 1, sg.y1, col1, 1.0f);
+    imgSeg.normalize(0, 255).save("./results/road_hough_segments.png");
+
+    // Full voting vs. progressive probabilistic voting on the upscaled image.
+    std::vector<EdgePoint> bigEdges = SelectEdgePoints(big, 360, 0.2f, true);
+    {
+        auto start = std::chrono::steady_clock::now();
+        CImg<> acc = HoughVote(bigEdges, 360, 1000, rhomax, 180, 1);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Full voting (" << bigEdges.size() << " edge points, 1 thread): "
+                  << elapsed.count() * 1000 << " ms" << std::endl;
+    }
+    {
+        auto start = std::chrono::steady_clock::now();
+        segments = HoughProbabilistic(big, bigEdges, 360, 1000, 200, 240, 20, 4, nbVoted);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Progressive probabilistic voting (" << nbVoted << " edge points voted, "
+                  << segments.size() << " segments): " << elapsed.count() * 1000 << " ms" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,325 @@
+/*
+    Spatially uniform keypoint selection (grid bucketing and ANMS)
+
+    The Harris and Shi-Tomasi detectors keep the global top-n responses,
+    which tend to cluster on the most contrasted structures. This file
+    redistributes the candidates over the image, either by keeping the
+    k best responses of each cell of a regular grid, or by adaptive
+    non-maximal suppression (Brown, Szeliski and Winder, 2005).
+*/
+
+#define cimg_use_png
+#include "CImg.h"
+
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+using namespace cimg_library;
+
+// Keypoint candidate: position and detector response.
+struct Keypoint
+{
+    float x, y, score;
+};
+
+/*
+  Corner response (Harris or Shi-Tomasi).
+  imgIn     : Input image
+  k         : Sensitivity parameter (Harris only)
+  shiTomasi : true for min(lambda1, lambda2), false for det - k * trace^2
+*/
+CImg<> CornerResponse(CImg<> &imgIn, float k, bool shiTomasi)
+{
+    // Structure tensor.
+    CImg<> M = imgIn.get_structure_tensors(true);
+    CImg<>
+        Ixx = M.get_channel(0),
+        Ixy = M.get_channel(1),
+        Iyy = M.get_channel(2);
+
+    CImg<>
+        det = Ixx.get_mul(Iyy) - Ixy.get_sqr(),
+        trace = Ixx + Iyy;
+    if (!shiTomasi)
+        return det - k * trace.get_sqr();
+
+    CImg<> diff = (trace.get_sqr() - 4 * det).max(0.0f).sqrt();
+    return (trace - diff) / 2; // Smallest eigenvalue
+}
+
+/*
+  Candidates of a corner response: strict local maxima in a 3x3
+  neighborhood, above a fraction of the maximal response.
+  R           : Corner response
+  relThreshold: Minimal response, relative to the maximum of R
+*/
+std::vector<Keypoint> ExtractCandidates(CImg<> &R, float relThreshold)
+{
+    std::vector<Keypoint> candidates;
+    float th = std::max(relThreshold * R.max(), 0.0f);
+    CImg_3x3(I, float);
+    cimg_for3x3(R, x, y, 0, 0, I, float)
+    {
+        if (x == 0 || y == 0 || x == R.width() - 1 || y == R.height() - 1 || Icc <= th)
+            continue;
+        if (Icc > Ipp && Icc > Icp && Icc > Inp &&
+            Icc > Ipc && Icc > Inc &&
+            Icc > Ipn && Icc > Icn && Icc > Inn)
+            candidates.push_back({(float)x, (float)y, Icc});
+    }
+    return candidates;
+}
+
+/*
+  Grid bucketing: the image is divided into cells of size cellSize x cellSize
+  and the kPerCell strongest candidates of each cell are kept.
+  The candidates are sorted into the cells with a counting sort, so the
+  cost is linear in the number of candidates.
+  candidates : Input keypoints
+  w, h       : Image size
+  cellSize   : Size of a cell (in pixels)
+  kPerCell   : Number of keypoints kept per cell
+*/
+std::vector<Keypoint> GridBucketing(const std::vector<Keypoint> &candidates, int w, int h,
+                                    int cellSize, int kPerCell)
+{
+    if (kPerCell <= 0 || candidates.empty())
+        return std::vector<Keypoint>();
+    int
+        nbX = (w + cellSize - 1) / cellSize,
+        nbY = (h + cellSize - 1) / cellSize,
+        nbCells = nbX * nbY;
+
+    // Cell of each candidate and histogram of the cells.
+    std::vector<int>
+        cellOf(candidates.size()),
+        start(nbCells + 1, 0);
+    for (size_t i = 0; i < candidates.size(); ++i)
+    {
+        int
+            cx = std::min(std::max((int)candidates[i].x / cellSize, 0), nbX - 1),
+            cy = std::min(std::max((int)candidates[i].y / cellSize, 0), nbY - 1);
+        cellOf[i] = cx + cy * nbX;
+        ++start[cellOf[i] + 1];
+    }
+    for (int c = 0; c < nbCells; ++c)
+        start[c + 1] += start[c];
+
+    // Counting sort of the candidates by cell.
+    std::vector<Keypoint> sorted(candidates.size());
+    std::vector<int> fill(start.begin(), start.end() - 1);
+    for (size_t i = 0; i < candidates.size(); ++i)
+        sorted[fill[cellOf[i]]++] = candidates[i];
+
+    // Top-k of each cell.
+    std::vector<Keypoint> selected;
+    selected.reserve(std::min((size_t)nbCells * kPerCell, candidates.size()));
+    auto stronger = [](const Keypoint &a, const Keypoint &b) { return a.score > b.score; };
+    for (int c = 0; c < nbCells; ++c)
+    {
+        auto
+            first = sorted.begin() + start[c],
+            last = sorted.begin() + start[c + 1];
+        if (last - first > kPerCell)
+        {
+            std::nth_element(first, first + kPerCell - 1, last, stronger);
+            last = first + kPerCell;
+        }
+        selected.insert(selected.end(), first, last);
+    }
+    return selected;
+}
+
+/*
+  Adaptive non-maximal suppression.
+  The suppression radius of a keypoint is its distance to the nearest keypoint
+  whose response is significantly larger (score * cRobust > score of the
+  keypoint). The n keypoints with the largest radii are kept.
+  Keypoints are processed by decreasing response and the stronger ones are
+  inserted into a uniform grid, which is searched ring by ring around the
+  current keypoint until no unvisited cell can contain a closer point.
+  candidates : Input keypoints
+  w, h       : Image size
+  n          : Number of keypoints to keep
+  cRobust    : Robustness factor (0.9 in the original paper)
+*/
+std::vector<Keypoint> AdaptiveNMS(const std::vector<Keypoint> &candidates, int w, int h,
+                                  int n, float cRobust = 0.9f)
+{
+    int nbPoints = (int)candidates.size();
+    if (n <= 0)
+        return std::vector<Keypoint>();
+    if (nbPoints <= n)
+        return candidates;
+
+    // Keypoints sorted by decreasing response.
+    std::vector<Keypoint> sorted(candidates);
+    std::sort(sorted.begin(), sorted.end(),
+              [](const Keypoint &a, const Keypoint &b) { return a.score > b.score; });
+
+    // Grid with about 2 points per cell, stored as singly linked lists.
+    int cellSize = std::max(1, (int)std::sqrt(2.0f * w * h / nbPoints));
+    int
+        nbX = (w + cellSize - 1) / cellSize,
+        nbY = (h + cellSize - 1) / cellSize;
+    std::vector<int>
+        head(nbX * nbY, -1),
+        next(nbPoints, -1);
+    auto cellX = [&](float x) { return std::min(std::max((int)x / cellSize, 0), nbX - 1); };
+    auto cellY = [&](float y) { return std::min(std::max((int)y / cellSize, 0), nbY - 1); };
+
+    const float inf = std::numeric_limits<float>::max();
+    std::vector<float> radius2(nbPoints, inf);
+    int inserted = 0;
+    for (int i = 0; i < nbPoints; ++i)
+    {
+        const Keypoint &p = sorted[i];
+
+        // Insert every keypoint significantly stronger than p.
+        while (inserted < i && sorted[inserted].score * cRobust > p.score)
+        {
+            int c = cellX(sorted[inserted].x) + cellY(sorted[inserted].y) * nbX;
+            next[inserted] = head[c];
+            head[c] = inserted++;
+        }
+        if (!inserted)
+            continue;
+
+        // Ring search around the cell of p.
+        int
+            cx = cellX(p.x),
+            cy = cellY(p.y),
+            maxRing = std::max(std::max(cx, nbX - 1 - cx), std::max(cy, nbY - 1 - cy));
+        float best = inf;
+        for (int ring = 0; ring <= maxRing; ++ring)
+        {
+            for (int y = cy - ring; y <= cy + ring; ++y)
+            {
+                if (y < 0 || y >= nbY)
+                    continue;
+                bool border = (y == cy - ring || y == cy + ring);
+                for (int x = cx - ring; x <= cx + ring; x += (border ? 1 : 2 * ring))
+                {
+                    if (x >= 0 && x < nbX)
+                        for (int j = head[x + y * nbX]; j >= 0; j = next[j])
+                        {
+                            float d2 = cimg::sqr(sorted[j].x - p.x) + cimg::sqr(sorted[j].y - p.y);
+                            best = std::min(best, d2);
+                        }
+                }
+            }
+            // Unvisited cells are at least ring * cellSize away.
+            if (best <= cimg::sqr((float)ring * cellSize))
+                break;
+        }
+        radius2[i] = best;
+    }
+
+    // Keep the n largest radii.
+    std::vector<int> order(nbPoints);
+    for (int i = 0; i < nbPoints; ++i)
+        order[i] = i;
+    std::nth_element(order.begin(), order.begin() + n - 1, order.end(),
+                     [&](int a, int b) { return radius2[a] > radius2[b]; });
+    std::vector<Keypoint> selected(n);
+    for (int i = 0; i < n; ++i)
+        selected[i] = sorted[order[i]];
+    return selected;
+}
+
+/*
+  Global top-n, as done in harris.cpp and shi_tomasi.cpp.
+*/
+std::vector<Keypoint> TopN(const std::vector<Keypoint> &candidates, int n)
+{
+    std::vector<Keypoint> selected(candidates);
+    n = std::max(0, std::min(n, (int)selected.size()));
+    std::partial_sort(selected.begin(), selected.begin() + n, selected.end(),
+                      [](const Keypoint &a, const Keypoint &b) { return a.score > b.score; });
+    selected.resize(n);
+    return selected;
+}
+
+/*
+  Display of the selected keypoints as red crosses.
+*/
+CImg<> DrawKeypoints(CImg<> &imgIn, const std::vector<Keypoint> &keypoints)
+{
+    CImg<> imgOut(imgIn);
+    unsigned char red[] = {200, 0, 0};
+    int line_length = 10;
+    for (const Keypoint &kp : keypoints)
+    {
+        int posx = (int)kp.x, posy = (int)kp.y;
+        imgOut.draw_line(posx - line_length, posy, posx + line_length, posy, red);
+        imgOut.draw_line(posx, posy - line_length, posx, posy + line_length, red);
+    }
+    return imgOut;
+}
+
+/*
+  Timing of a selection function, in milliseconds (best of nbRuns).
+*/
+template <typename F>
+double BestTime(F f, int nbRuns = 10)
+{
+    double best = std::numeric_limits<double>::max();
+    for (int r = 0; r < nbRuns; ++r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+int main()
+{
+    CImg<unsigned char> img("../images/lighthouse.png");
+    CImg<> lum = img.resize(512, 256);
+    int n = 50;
+
+    // Harris and Shi-Tomasi candidates.
+    CImg<> harris = CornerResponse(lum, 0.04f, false),
+           shiTomasi = CornerResponse(lum, 0.04f, true);
+    std::vector<Keypoint>
+        harrisCandidates = ExtractCandidates(harris, 0.01f),
+        shiTomasiCandidates = ExtractCandidates(shiTomasi, 0.01f);
+    std::cout << "Harris candidates: " << harrisCandidates.size() << std::endl;
+    std::cout << "Shi-Tomasi candidates: " << shiTomasiCandidates.size() << std::endl;
+
+    DrawKeypoints(lum, TopN(harrisCandidates, n)).normalize(0, 255).save("./results/lighthouse_harris_topn.png");
+    DrawKeypoints(lum, GridBucketing(harrisCandidates, lum.width(), lum.height(), 64, 2))
+        .normalize(0, 255).save("./results/lighthouse_harris_grid.png");
+    DrawKeypoints(lum, AdaptiveNMS(harrisCandidates, lum.width(), lum.height(), n))
+        .normalize(0, 255).save("./results/lighthouse_harris_anms.png");
+    DrawKeypoints(lum, AdaptiveNMS(shiTomasiCandidates, lum.width(), lum.height(), n))
+        .normalize(0, 255).save("./results/lighthouse_shi_tomasi_anms.png");
+
+    // Benchmark on 100k random candidates in a full-HD frame.
+    int w = 1920, h = 1080, nbCandidates = 100000;
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float>
+        ux(0, (float)w), uy(0, (float)h), us(0, 1);
+    std::vector<Keypoint> candidates(nbCandidates);
+    for (Keypoint &kp : candidates)
+        kp = {ux(rng), uy(rng), us(rng)};
+
+    std::vector<Keypoint> bucketed;
+    double
+        tGrid = BestTime([&]() { bucketed = GridBucketing(candidates, w, h, 32, 2); }),
+        tANMS = BestTime([&]() { AdaptiveNMS(candidates, w, h, 1000); }),
+        tPipeline = BestTime([&]() { AdaptiveNMS(GridBucketing(candidates, w, h, 32, 2), w, h, 1000); });
+    std::cout << "Grid bucketing (" << nbCandidates << " -> " << bucketed.size() << "): " << tGrid << " ms" << std::endl;
+    std::cout << "ANMS (" << nbCandidates << " -> 1000): " << tANMS << " ms" << std::endl;
+    std::cout << "Grid bucketing + ANMS: " << tPipeline << " ms" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,248 @@
+/*
+    Local Binary Pattern (LBP) with precomputed sampling
+
+    The sampling points of the circle do not depend on the pixel, so their
+    integer offsets and interpolation weights are computed once per (R, p). Each
+    row is then processed sample by sample: the p interpolated values of a
+    whole row are compared to the center row and packed into bitmasks, in
+    loops over contiguous memory that the compiler can vectorize. The
+    rotation invariant uniform mapping (riu2) is read from a lookup table.
+*/
+
+#define cimg_use_png
+#include "CImg.h"
+
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+using namespace cimg_library;
+
+// Precomputed LBP operator for a radius R and p neighbors.
+struct LBPOperator
+{
+    int p, border;
+    std::vector<int> ix, iy;                // Integer part of the offsets
+    std::vector<float> fx, fy;              // Fractional part of the offsets
+    std::vector<unsigned char> lut;         // riu2 mapping of the codes (p <= 24)
+};
+
+/*
+  riu2 label of a p-bit code: number of 1s if the circular pattern has at
+  most two 0/1 transitions (uniform pattern), p + 1 otherwise.
+*/
+inline unsigned char Riu2(unsigned int code, int p)
+{
+    unsigned int
+        mask = p == 32 ? ~0U : (1U << p) - 1,
+        rotated = ((code << 1) | (code >> (p - 1))) & mask;
+    return __builtin_popcount(code ^ rotated) <= 2 ? __builtin_popcount(code) : p + 1;
+}
+
+/*
+  Sampling offsets, interpolation weights and lookup table of the operator.
+  R : Radius of the circle
+  p : Number of neighbors (at most 32)
+*/
+LBPOperator MakeLBPOperator(float R, int p)
+{
+    if (p < 1 || p > 32)
+        throw CImgArgumentException("MakeLBPOperator(): %d neighbors, expected 1 to 32.", p);
+    LBPOperator op;
+    op.p = p;
+    op.border = (int)std::ceil(R) + 1;
+    for (int n = 0; n < p; ++n)
+    {
+        // Same sampling points as lbp.cpp, snapped when close to the grid.
+        double
+            dx = -R * std::sin(2 * cimg::PI * n / p),
+            dy = R * std::cos(2 * cimg::PI * n / p);
+        if (std::abs(dx - std::round(dx)) < 1e-6)
+            dx = std::round(dx);
+        if (std::abs(dy - std::round(dy)) < 1e-6)
+            dy = std::round(dy);
+        int
+            ix = (int)std::floor(dx),
+            iy = (int)std::floor(dy);
+        op.ix.push_back(ix);
+        op.iy.push_back(iy);
+        op.fx.push_back((float)(dx - ix));
+        op.fy.push_back((float)(dy - iy));
+    }
+    if (p <= 24)
+    {
+        op.lut.resize(1U << p);
+        for (unsigned int code = 0; code < op.lut.size(); ++code)
+            op.lut[code] = Riu2(code, p);
+    }
+    return op;
+}
+
+/*
+  LBP and contrast - rotation invariant version
+  imgIn     : input image
+  op        : LBP operator
+  lbp,C     : output images
+  nbThreads : number of threads (rows are split into bands)
+*/
+void LBPFast(const CImg<> &imgIn, const LBPOperator &op, CImg<> &lbp, CImg<> &C, unsigned int nbThreads)
+{
+    int
+        w = imgIn.width(),
+        h = imgIn.height(),
+        b = op.border,
+        p = op.p;
+    lbp.assign(w, h, 1, 1, 0);
+    C.assign(w, h, 1, 1, 0);
+    if (w <= 2 * b || h <= 2 * b)
+        return;
+
+    auto band = [&, w, b, p](int y0, int y1)
+    {
+        std::vector<unsigned int> code(w);
+        std::vector<float> sum(w), sum2(w);
+        for (int y = y0; y < y1; ++y)
+        {
+            const float *center = imgIn.data(0, y);
+            std::fill(code.begin(), code.end(), 0U);
+            std::fill(sum.begin(), sum.end(), 0.0f);
+            std::fill(sum2.begin(), sum2.end(), 0.0f);
+            for (int n = 0; n < p; ++n)
+            {
+                const float
+                    *r0 = imgIn.data(0, y + op.iy[n]) + op.ix[n],
+                    *r1 = r0 + w,
+                    fx = op.fx[n], fy = op.fy[n], fxy = fx * fy;
+                for (int x = b; x < w - b; ++x)
+                {
+                    // Bilinear interpolation, written to be exact on constant areas.
+                    float
+                        a = r0[x],
+                        v = a + fx * (r0[x + 1] - a) + fy * (r1[x] - a) + fxy * (a - r0[x + 1] - r1[x] + r1[x + 1]);
+                    code[x] |= (unsigned int)(v > center[x]) << n;
+                    sum[x] += v;
+                    sum2[x] += v * v;
+                }
+            }
+            float *pl = lbp.data(0, y), *pc = C.data(0, y);
+            for (int x = b; x < w - b; ++x)
+            {
+                pl[x] = op.lut.empty() ? Riu2(code[x], p) : op.lut[code[x]];
+                float mean = sum[x] / p;
+                pc[x] = sum2[x] / p - mean * mean;
+            }
+        }
+    };
+
+    nbThreads = std::max(1u, nbThreads);
+    int nbRows = h - 2 * b;
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(band, b + nbRows * t / nbThreads, b + nbRows * (t + 1) / nbThreads);
+    for (auto &wk : workers)
+        wk.join();
+}
+
+/*
+  Reference implementation, copied from lbp.cpp for the benchmark.
+*/
+void LBP(CImg<> &imgIn, float R, int p, CImg<> &lbp, CImg<> &C)
+{
+    float PI2 = 2 * cimg::PI;
+    cimg_for_insideXY(imgIn, x, y, (int)(R + 1))
+    {
+        float
+            Ibar = 0,
+            Vc = imgIn(x, y);
+
+        // Sampling p points on the circle of radius R
+        CImg<> xi(p, 2, 1, 1, 0), V(p);
+        cimg_forX(V, n)
+        {
+            xi(n, 0) = x - R * std::sin(PI2 * n / p);
+            xi(n, 1) = y + R * std::cos(PI2 * n / p);
+            V(n) = imgIn.linear_atXY(xi(n, 0), xi(n, 1));
+            Ibar += V(n);
+        }
+        // Mean of the grey-levels
+        Ibar /= p;
+
+        // Computing U
+        float U = 0;
+        for (int n = 1; n < p; ++n)
+        {
+            float Vj = imgIn.linear_atXY(xi(n - 1, 0), xi(n - 1, 1));
+            U += cimg::abs(V(n) - Vc > 0 ? 1 : 0) - cimg::abs(Vj - Vc > 0 ? 1 : 0);
+        }
+
+        // Fence post
+        float
+            Vi = imgIn.linear_atXY(xi(p - 1, 0), xi(p - 1, 1)),
+            Vj = imgIn.linear_atXY(xi(0, 0), xi(0, 1));
+        U += cimg::abs((Vi - Vc > 0 ? 1 : 0) - (Vj - Vc > 0 ? 1 : 0));
+
+        // Computing the LBP
+        if (U > 2)
+            lbp(x, y) = p + 1;
+        else
+            cimg_forX(V, n)
+                lbp(x, y) += (V(n) - Vc > 0 ? 1 : 0);
+
+        // Computing contrast
+        cimg_forX(V, n)
+            C(x, y) += cimg::sqr(V(n) - Ibar);
+        C(x, y) /= p;
+    }
+}
+
+int main()
+{
+    std::vector<std::string> images = {
+        "cracked", "banded", "cobwebbed", "dotted", "bubbly", "fibrous",
+        "honeycombed", "grid", "spiralled", "chequered", "wrinkled", "braided"};
+
+    float R = 2;
+    int p = 20;
+    unsigned int nbThreads = std::max(1u, std::thread::hardware_concurrency());
+    LBPOperator op = MakeLBPOperator(R, p);
+
+    double timeRef = 0, timeFast = 0;
+    size_t nbPixels = 0, nbUniform = 0, nbMismatch = 0;
+    for (auto &image : images)
+        for (int i = 1; i <= 2; ++i)
+        {
+            CImg<> imgIn(("../textures/" + image + std::to_string(i) + ".png").c_str());
+            imgIn.norm();
+
+            CImg<> lbpRef(imgIn.width(), imgIn.height(), 1, 1, 0), CRef(lbpRef), lbp, C;
+            auto t0 = std::chrono::steady_clock::now();
+            LBP(imgIn, R, p, lbpRef, CRef);
+            auto t1 = std::chrono::steady_clock::now();
+            LBPFast(imgIn, op, lbp, C, nbThreads);
+            auto t2 = std::chrono::steady_clock::now();
+            timeRef += std::chrono::duration<double>(t1 - t0).count();
+            timeFast += std::chrono::duration<double>(t2 - t1).count();
+
+            // The reference U telescopes to 0 or 2, so it never labels a pattern
+            // as non-uniform: compare the uniform patterns only.
+            cimg_forXY(lbp, x, y) if (lbp(x, y) <= p)
+            {
+                ++nbUniform;
+                nbMismatch += lbp(x, y) != lbpRef(x, y);
+            }
+            nbPixels += imgIn.size();
+            if (image == "grid" && i == 1)
+                lbp.get_normalize(0, 255).save_png("./results/grid1_lbp.png");
+        }
+
+    std::cout << "Pixels: " << nbPixels << ", uniform patterns: " << nbUniform
+              << ", mismatches with lbp.cpp: " << nbMismatch << std::endl;
+    std::cout << "lbp.cpp: " << timeRef * 1000 << " ms, lbp_fast.cpp: " << timeFast * 1000
+              << " ms (" << nbThreads << " threads), speedup: " << timeRef / timeFast << "x" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,487 @@
+/*
+    Texture retrieval index for LBP histograms
+
+    The concatenated LBP histograms of a corpus are computed once and stored
+    in a binary file of fixed-size records, which is memory-mapped at query
+    time. Images are appended to the index without rewriting it, and the
+    top-k queries (L1 or chi-square distance) scan the records in parallel.
+
+    File layout (native endianness):
+      header : char magic[8] = "LBPIDX1", uint32 dim, uint32 count
+      record : float histogram[dim], char name[64]
+*/
+
+#define cimg_use_png
+#include "CImg.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace cimg_library;
+
+// Precomputed LBP operator for a radius R and p neighbors.
+struct LBPOperator
+{
+    int p, border;
+    std::vector<int> ix, iy;                // Integer part of the offsets
+    std::vector<float> fx, fy;              // Fractional part of the offsets
+    std::vector<unsigned char> lut;         // riu2 mapping of the codes (p <= 24)
+};
+
+/*
+  riu2 label of a p-bit code: number of 1s if the circular pattern has at
+  most two 0/1 transitions (uniform pattern), p + 1 otherwise.
+*/
+inline unsigned char Riu2(unsigned int code, int p)
+{
+    unsigned int
+        mask = p == 32 ? ~0U : (1U << p) - 1,
+        rotated = ((code << 1) | (code >> (p - 1))) & mask;
+    return __builtin_popcount(code ^ rotated) <= 2 ? __builtin_popcount(code) : p + 1;
+}
+
+/*
+  Sampling offsets, interpolation weights and lookup table of the operator.
+  R : Radius of the circle
+  p : Number of neighbors (at most 32)
+*/
+LBPOperator MakeLBPOperator(float R, int p)
+{
+    if (p < 1 || p > 32)
+        throw CImgArgumentException("MakeLBPOperator(): %d neighbors, expected 1 to 32.", p);
+    LBPOperator op;
+    op.p = p;
+    op.border = (int)std::ceil(R) + 1;
+    for (int n = 0; n < p; ++n)
+    {
+        // Same sampling points as lbp.cpp, snapped when close to the grid.
+        double
+            dx = -R * std::sin(2 * cimg::PI * n / p),
+            dy = R * std::cos(2 * cimg::PI * n / p);
+        if (std::abs(dx - std::round(dx)) < 1e-6)
+            dx = std::round(dx);
+        if (std::abs(dy - std::round(dy)) < 1e-6)
+            dy = std::round(dy);
+        int
+            ix = (int)std::floor(dx),
+            iy = (int)std::floor(dy);
+        op.ix.push_back(ix);
+        op.iy.push_back(iy);
+        op.fx.push_back((float)(dx - ix));
+        op.fy.push_back((float)(dy - iy));
+    }
+    if (p <= 24)
+    {
+        op.lut.resize(1U << p);
+        for (unsigned int code = 0; code < op.lut.size(); ++code)
+            op.lut[code] = Riu2(code, p);
+    }
+    return op;
+}
+
+/*
+  LBP and contrast - rotation invariant version
+  imgIn     : input image
+  op        : LBP operator
+  lbp,C     : output images
+  nbThreads : number of threads (rows are split into bands)
+*/
+void LBPFast(const CImg<> &imgIn, const LBPOperator &op, CImg<> &lbp, CImg<> &C, unsigned int nbThreads)
+{
+    int
+        w = imgIn.width(),
+        h = imgIn.height(),
+        b = op.border,
+        p = op.p;
+    lbp.assign(w, h, 1, 1, 0);
+    C.assign(w, h, 1, 1, 0);
+    if (w <= 2 * b || h <= 2 * b)
+        return;
+
+    auto band = [&, w, b, p](int y0, int y1)
+    {
+        std::vector<unsigned int> code(w);
+        std::vector<float> sum(w), sum2(w);
+        for (int y = y0; y < y1; ++y)
+        {
+            const float *center = imgIn.data(0, y);
+            std::fill(code.begin(), code.end(), 0U);
+            std::fill(sum.begin(), sum.end(), 0.0f);
+            std::fill(sum2.begin(), sum2.end(), 0.0f);
+            for (int n = 0; n < p; ++n)
+            {
+                const float
+                    *r0 = imgIn.data(0, y + op.iy[n]) + op.ix[n],
+                    *r1 = r0 + w,
+                    fx = op.fx[n], fy = op.fy[n], fxy = fx * fy;
+                for (int x = b; x < w - b; ++x)
+                {
+                    // Bilinear interpolation, written to be exact on constant areas.
+                    float
+                        a = r0[x],
+                        v = a + fx * (r0[x + 1] - a) + fy * (r1[x] - a) + fxy * (a - r0[x + 1] - r1[x] + r1[x + 1]);
+                    code[x] |= (unsigned int)(v > center[x]) << n;
+                    sum[x] += v;
+                    sum2[x] += v * v;
+                }
+            }
+            float *pl = lbp.data(0, y), *pc = C.data(0, y);
+            for (int x = b; x < w - b; ++x)
+            {
+                pl[x] = op.lut.empty() ? Riu2(code[x], p) : op.lut[code[x]];
+                float mean = sum[x] / p;
+                pc[x] = sum2[x] / p - mean * mean;
+            }
+        }
+    };
+
+    nbThreads = std::max(1u, nbThreads);
+    int nbRows = h - 2 * b;
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(band, b + nbRows * t / nbThreads, b + nbRows * (t + 1) / nbThreads);
+    for (auto &wk : workers)
+        wk.join();
+}
+
+/*
+    LBP concatenated histogram.
+    Same layout as LBPHistogram in lbp.cpp (nbX x nbY patches), but the LBP is
+    computed once on the whole image, each label has its own bin, and each
+    patch histogram is normalized to sum 1 so that images of different sizes
+    can be compared.
+*/
+CImg<> LBPHistogram(const CImg<> &imgIn, const LBPOperator &op, unsigned int nbThreads)
+{
+    int nbX = 5, nbY = 5, nbins = op.p + 2;
+    CImg<> lbp, C;
+    LBPFast(imgIn, op, lbp, C, nbThreads);
+
+    CImg<> hglobal(nbins * nbX * nbY, 1, 1, 1, 0);
+    int
+        b = op.border,
+        w = lbp.width() - 2 * b,
+        h = lbp.height() - 2 * b;
+    for (int y = 0; y < h; ++y)
+        for (int x = 0; x < w; ++x)
+        {
+            int i = x * nbX / w, j = y * nbY / h;
+            ++hglobal((j + i * nbY) * nbins + (int)lbp(x + b, y + b));
+        }
+    for (int patch = 0; patch < nbX * nbY; ++patch)
+    {
+        CImg<> h = hglobal.get_shared_points(patch * nbins, (patch + 1) * nbins - 1);
+        h /= std::max((float)h.sum(), 1.0f);
+    }
+    return hglobal;
+}
+
+// Header of an index file.
+struct IndexHeader
+{
+    char magic[8];
+    uint32_t dim, count;
+};
+
+const int nameSize = 64;
+
+/*
+  Appends a histogram to an index file, creating it if needed.
+  Nothing is written if an image of the same name is already indexed.
+  path : Index file
+  name : Name of the image
+  hist : Histogram
+*/
+bool IndexAdd(const std::string &path, const std::string &name, const CImg<> &hist)
+{
+    IndexHeader header;
+    std::FILE *file = std::fopen(path.c_str(), "r+b");
+    if (!file)
+    {
+        file = std::fopen(path.c_str(), "w+b");
+        if (!file)
+            throw CImgIOException("IndexAdd(): cannot create '%s'.", path.c_str());
+        std::memset(&header, 0, sizeof(header));
+        std::strcpy(header.magic, "LBPIDX1");
+        header.dim = hist.size();
+        header.count = 0;
+        std::fwrite(&header, sizeof(header), 1, file);
+    }
+    else if (std::fread(&header, sizeof(header), 1, file) != 1 || std::strcmp(header.magic, "LBPIDX1") ||
+             header.dim != hist.size())
+    {
+        std::fclose(file);
+        throw CImgIOException("IndexAdd(): '%s' is not an index of dimension %u.", path.c_str(), hist.size());
+    }
+
+    // Skip the images already indexed. Names are stored truncated to nameSize - 1 characters.
+    char stored[nameSize], record[nameSize];
+    std::memset(stored, 0, nameSize);
+    std::strncpy(stored, name.c_str(), nameSize - 1);
+    for (uint32_t i = 0; i < header.count; ++i)
+    {
+        std::fseek(file, sizeof(header) + (long)i * (header.dim * sizeof(float) + nameSize) + header.dim * sizeof(float), SEEK_SET);
+        if (std::fread(record, nameSize, 1, file) == 1 && !std::strncmp(stored, record, nameSize))
+        {
+            std::fclose(file);
+            return false;
+        }
+    }
+
+    // Append the record, then update the count.
+    std::fseek(file, sizeof(header) + (long)header.count * (header.dim * sizeof(float) + nameSize), SEEK_SET);
+    std::fwrite(hist.data(), sizeof(float), header.dim, file);
+    std::fwrite(stored, nameSize, 1, file);
+    ++header.count;
+    std::fseek(file, 0, SEEK_SET);
+    std::fwrite(&header, sizeof(header), 1, file);
+    std::fclose(file);
+    return true;
+}
+
+// Memory-mapped index (read-only).
+struct Index
+{
+    void *data = nullptr;
+    size_t length = 0;
+    uint32_t dim = 0, count = 0;
+
+    const float *histogram(uint32_t i) const
+    {
+        return (const float *)((const char *)data + sizeof(IndexHeader) + (size_t)i * (dim * sizeof(float) + nameSize));
+    }
+    const char *name(uint32_t i) const { return (const char *)(histogram(i) + dim); }
+};
+
+void IndexClose(Index &index)
+{
+    munmap(index.data, index.length);
+    index.data = nullptr;
+}
+
+Index IndexOpen(const std::string &path)
+{
+    Index index;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw CImgIOException("IndexOpen(): cannot read '%s'.", path.c_str());
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size < (off_t)sizeof(IndexHeader))
+    {
+        close(fd);
+        throw CImgIOException("IndexOpen(): cannot read '%s'.", path.c_str());
+    }
+    index.length = st.st_size;
+    index.data = mmap(nullptr, index.length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (index.data == MAP_FAILED)
+        throw CImgIOException("IndexOpen(): cannot map '%s'.", path.c_str());
+
+    // Reject foreign files, and files too short for the records they announce.
+    const IndexHeader *header = (const IndexHeader *)index.data;
+    size_t recordSize = header->dim * sizeof(float) + nameSize;
+    if (std::strncmp(header->magic, "LBPIDX1", sizeof(header->magic)) ||
+        header->count > (index.length - sizeof(IndexHeader)) / recordSize)
+    {
+        IndexClose(index);
+        throw CImgIOException("IndexOpen(): '%s' is not a valid index.", path.c_str());
+    }
+    index.dim = header->dim;
+    index.count = header->count;
+    return index;
+}
+
+// Distances between histograms, written as plain loops that the compiler vectorizes.
+float L1Distance(const float *h1, const float *h2, int dim)
+{
+    float d = 0;
+    for (int i = 0; i < dim; ++i)
+        d += std::abs(h1[i] - h2[i]);
+    return d;
+}
+
+float ChiSquareDistance(const float *h1, const float *h2, int dim)
+{
+    float d = 0;
+    for (int i = 0; i < dim; ++i)
+    {
+        float diff = h1[i] - h2[i], sum = h1[i] + h2[i];
+        d += diff * diff / (sum + 1e-10f);
+    }
+    return d;
+}
+
+// Result of a query.
+struct Match
+{
+    float distance;
+    uint32_t id;
+    bool operator<(const Match &m) const { return distance < m.distance || (distance == m.distance && id < m.id); }
+};
+
+/*
+  Top-k nearest neighbors of a histogram.
+  Each thread scans a range of records and keeps its own top-k, then the
+  partial results are merged. Ties are ordered by record id.
+  index     : Index
+  query     : Query histogram
+  k         : Number of neighbors
+  chiSquare : Chi-square distance (true) or L1 distance (false)
+  nbThreads : Number of threads
+*/
+std::vector<Match> IndexQuery(const Index &index, const CImg<> &query, int k, bool chiSquare,
+                              unsigned int nbThreads)
+{
+    if (query.size() != index.dim)
+        throw CImgArgumentException("IndexQuery(): query of dimension %u, index of dimension %u.",
+                                    query.size(), index.dim);
+    if (k <= 0 || index.count == 0)
+        return std::vector<Match>();
+    nbThreads = std::max(1u, nbThreads);
+    std::vector<std::vector<Match>> partial(nbThreads);
+    auto scan = [&](unsigned int t)
+    {
+        std::vector<Match> &top = partial[t];
+        uint32_t
+            first = (uint64_t)index.count * t / nbThreads,
+            last = (uint64_t)index.count * (t + 1) / nbThreads;
+        for (uint32_t i = first; i < last; ++i)
+        {
+            float d = chiSquare ? ChiSquareDistance(query.data(), index.histogram(i), index.dim)
+                                : L1Distance(query.data(), index.histogram(i), index.dim);
+            Match m = {d, i};
+            // Max-heap of the k best matches.
+            if ((int)top.size() < k)
+            {
+                top.push_back(m);
+                std::push_heap(top.begin(), top.end());
+            }
+            else if (m < top.front())
+            {
+                std::pop_heap(top.begin(), top.end());
+                top.back() = m;
+                std::push_heap(top.begin(), top.end());
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(scan, t);
+    for (auto &w : workers)
+        w.join();
+
+    std::vector<Match> matches;
+    for (auto &top : partial)
+        matches.insert(matches.end(), top.begin(), top.end());
+    std::sort(matches.begin(), matches.end());
+    if ((int)matches.size() > k)
+        matches.resize(k);
+    return matches;
+}
+
+int main()
+{
+    std::vector<std::string> images = {
+        "cracked", "banded", "cobwebbed", "dotted", "bubbly", "fibrous",
+        "honeycombed", "grid", "spiralled", "chequered", "wrinkled", "braided"};
+    unsigned int nbThreads = std::max(1u, std::thread::hardware_concurrency());
+    LBPOperator op = MakeLBPOperator(2, 20);
+    std::string path = "./results/textures.lbpidx";
+
+    // Indexing of the second image of each texture (only the new ones are computed).
+    Index index;
+    uint32_t count = 0;
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (file)
+    {
+        std::fclose(file);
+        index = IndexOpen(path);
+        count = index.count;
+    }
+    int nbAdded = 0;
+    for (auto &image : images)
+    {
+        std::string name = image + "2";
+        bool known = false;
+        for (uint32_t i = 0; i < count && !known; ++i)
+            known = !std::strncmp(name.c_str(), index.name(i), nameSize);
+        if (known)
+            continue;
+        CImg<> imgIn(("../textures/" + name + ".png").c_str());
+        imgIn.norm();
+        nbAdded += IndexAdd(path, name, LBPHistogram(imgIn, op, nbThreads));
+    }
+    if (index.data)
+        IndexClose(index);
+    std::cout << "Added " << nbAdded << " images to " << path << std::endl;
+
+    // Queries with the first image of each texture.
+    index = IndexOpen(path);
+    int nbCorrectL1 = 0, nbCorrectChi2 = 0;
+    for (auto &image : images)
+    {
+        CImg<> imgIn(("../textures/" + image + "1.png").c_str());
+        imgIn.norm();
+        CImg<> query = LBPHistogram(imgIn, op, nbThreads);
+        std::vector<Match>
+            l1 = IndexQuery(index, query, 3, false, nbThreads),
+            chi2 = IndexQuery(index, query, 3, true, nbThreads);
+        std::cout << image << "1 -> L1:";
+        for (const Match &m : l1)
+            std::cout << " " << index.name(m.id) << " (" << m.distance << ")";
+        std::cout << ", chi-square:";
+        for (const Match &m : chi2)
+            std::cout << " " << index.name(m.id) << " (" << m.distance << ")";
+        std::cout << std::endl;
+        nbCorrectL1 += image + "2" == index.name(l1[0].id);
+        nbCorrectChi2 += image + "2" == index.name(chi2[0].id);
+    }
+    std::cout << "Top-1 accuracy: L1 " << nbCorrectL1 << "/" << images.size()
+              << ", chi-square " << nbCorrectChi2 << "/" << images.size() << std::endl;
+
+    // Scan throughput on a synthetic index of 100k random histograms.
+    std::string benchPath = "./results/bench.lbpidx";
+    std::remove(benchPath.c_str());
+    {
+        CImg<> h(index.dim);
+        std::FILE *bench = std::fopen(benchPath.c_str(), "wb");
+        IndexHeader header = {"LBPIDX1", index.dim, 100000};
+        std::fwrite(&header, sizeof(header), 1, bench);
+        char name[nameSize] = "random";
+        for (uint32_t i = 0; i < header.count; ++i)
+        {
+            h.rand(0, 1);
+            std::fwrite(h.data(), sizeof(float), index.dim, bench);
+            std::fwrite(name, nameSize, 1, bench);
+        }
+        std::fclose(bench);
+    }
+    Index benchIndex = IndexOpen(benchPath);
+    CImg<> query(index.histogram(0), index.dim);
+    for (bool chiSquare : {false, true})
+    {
+        auto start = std::chrono::steady_clock::now();
+        IndexQuery(benchIndex, query, 10, chiSquare, nbThreads);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << (chiSquare ? "Chi-square" : "L1") << " top-10 over " << benchIndex.count << " histograms: "
+                  << elapsed.count() * 1000 << " ms (" << nbThreads << " threads)" << std::endl;
+    }
+    IndexClose(benchIndex);
+    IndexClose(index);
+    std::remove(benchPath.c_str());
+
+    return 0;
+}
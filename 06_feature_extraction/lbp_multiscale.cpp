@@ -0,0 +1,314 @@
+/*
+    Multi-scale LBP descriptor
+
+    Several (R, p) operators are applied in the same pass over the image.
+    Their sampling points are merged, so a point shared by several scales of
+    the same radius (the p points of (R, p) are also points of (R, 2p)) is
+    interpolated only once per pixel. The labels are accumulated into the cells of the
+    finest grid in the same sweep, and turned into an integral histogram, from
+    which the cells of every level of a spatial pyramid are read with four
+    lookups per bin. No patch is cropped, so no pixel is lost at patch borders.
+*/
+
+#define cimg_use_png
+#include "CImg.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+using namespace cimg_library;
+
+// One scale of the descriptor: LBP radius, number of neighbors, and number of
+// pyramid levels (level l has 2^l x 2^l cells).
+struct LBPScale
+{
+    float R;
+    int p, levels;
+};
+
+// Sampling point, shared by the scales listed in uses as (scale, bit).
+struct Sample
+{
+    int ix, iy;
+    float fx, fy;
+    std::vector<std::pair<int, int>> uses;
+};
+
+struct MultiScaleLBP
+{
+    std::vector<LBPScale> scales;
+    std::vector<Sample> samples;
+    std::vector<std::vector<unsigned char>> luts; // riu2 mapping of each scale
+    int border, size;                             // Border of the image, size of the descriptor
+};
+
+/*
+  riu2 label of a p-bit code: number of 1s if the circular pattern has at
+  most two 0/1 transitions (uniform pattern), p + 1 otherwise.
+*/
+inline unsigned char Riu2(unsigned int code, int p)
+{
+    unsigned int
+        mask = p == 32 ? ~0U : (1U << p) - 1,
+        rotated = ((code << 1) | (code >> (p - 1))) & mask;
+    return __builtin_popcount(code ^ rotated) <= 2 ? __builtin_popcount(code) : p + 1;
+}
+
+/*
+  Merged sampling points and lookup tables of a set of scales.
+  scales : (R, p, levels) of each scale, with 1 <= p <= 24 (size of the
+           lookup tables) and levels >= 1
+*/
+MultiScaleLBP MakeMultiScaleLBP(const std::vector<LBPScale> &scales)
+{
+    for (const LBPScale &scale : scales)
+        if (scale.p < 1 || scale.p > 24 || scale.levels < 1)
+            throw CImgArgumentException("MakeMultiScaleLBP(): invalid scale (p = %d, levels = %d), "
+                                        "expected 1 <= p <= 24 and levels >= 1.",
+                                        scale.p, scale.levels);
+    MultiScaleLBP ms;
+    ms.scales = scales;
+    ms.border = 0;
+    ms.size = 0;
+    for (int s = 0; s < (int)scales.size(); ++s)
+    {
+        float R = scales[s].R;
+        int p = scales[s].p;
+        ms.border = std::max(ms.border, (int)std::ceil(R) + 1);
+        for (int n = 0; n < p; ++n)
+        {
+            double
+                dx = -R * std::sin(2 * cimg::PI * n / p),
+                dy = R * std::cos(2 * cimg::PI * n / p);
+            if (std::abs(dx - std::round(dx)) < 1e-6)
+                dx = std::round(dx);
+            if (std::abs(dy - std::round(dy)) < 1e-6)
+                dy = std::round(dy);
+            int ix = (int)std::floor(dx), iy = (int)std::floor(dy);
+            float fx = (float)(dx - ix), fy = (float)(dy - iy);
+
+            // Reuse an existing sampling point at the same position.
+            auto same = std::find_if(ms.samples.begin(), ms.samples.end(), [&](const Sample &sp)
+                                     { return sp.ix == ix && sp.iy == iy &&
+                                              std::abs(sp.fx - fx) < 1e-5f && std::abs(sp.fy - fy) < 1e-5f; });
+            if (same == ms.samples.end())
+            {
+                ms.samples.push_back({ix, iy, fx, fy, {}});
+                same = ms.samples.end() - 1;
+            }
+            same->uses.push_back(std::make_pair(s, n));
+        }
+
+        ms.luts.emplace_back(1U << p);
+        for (unsigned int code = 0; code < ms.luts[s].size(); ++code)
+            ms.luts[s][code] = Riu2(code, p);
+
+        int nbCells = 0;
+        for (int l = 0; l < scales[s].levels; ++l)
+            nbCells += 1 << (2 * l);
+        ms.size += nbCells * (p + 2);
+    }
+    return ms;
+}
+
+/*
+  Multi-scale LBP descriptor of an image.
+  imgIn : Input image (one channel)
+  ms    : Operator
+  Returns the concatenation, for each scale and each pyramid level, of the
+  normalized histograms of the cells.
+*/
+CImg<> MultiScaleDescriptor(const CImg<> &imgIn, const MultiScaleLBP &ms)
+{
+    int
+        w = imgIn.width(),
+        h = imgIn.height(),
+        b = ms.border,
+        nbScales = (int)ms.scales.size();
+    CImg<> descriptor(ms.size, 1, 1, 1, 0);
+    if (w <= 2 * b || h <= 2 * b)
+        return descriptor;
+    int iw = w - 2 * b, ih = h - 2 * b;
+
+    // Counts of the labels in the cells of the finest grid of each scale.
+    std::vector<std::vector<unsigned int>> counts(nbScales);
+    std::vector<std::vector<int>> cellOfColumn(nbScales);
+    for (int s = 0; s < nbScales; ++s)
+    {
+        int G = 1 << (ms.scales[s].levels - 1);
+        counts[s].assign(G * G * (ms.scales[s].p + 2), 0);
+        for (int x = 0; x < iw; ++x)
+            cellOfColumn[s].push_back(x * G / iw);
+    }
+
+    // Single sweep: codes of all the scales, then labels into the cells.
+    std::vector<std::vector<unsigned int>> code(nbScales, std::vector<unsigned int>(w));
+    std::vector<float> values(w);
+    for (int y = b; y < h - b; ++y)
+    {
+        const float *center = imgIn.data(0, y);
+        for (auto &c : code)
+            std::fill(c.begin(), c.end(), 0U);
+        for (const Sample &sp : ms.samples)
+        {
+            const float
+                *r0 = imgIn.data(0, y + sp.iy) + sp.ix,
+                *r1 = r0 + w,
+                fx = sp.fx, fy = sp.fy, fxy = fx * fy;
+            float *v = values.data();
+            for (int x = b; x < w - b; ++x)
+            {
+                float a = r0[x];
+                v[x] = a + fx * (r0[x + 1] - a) + fy * (r1[x] - a) + fxy * (a - r0[x + 1] - r1[x] + r1[x + 1]);
+            }
+            for (const auto &use : sp.uses)
+            {
+                unsigned int *c = code[use.first].data(), bit = use.second;
+                for (int x = b; x < w - b; ++x)
+                    c[x] |= (unsigned int)(v[x] > center[x]) << bit;
+            }
+        }
+        for (int s = 0; s < nbScales; ++s)
+        {
+            int
+                G = 1 << (ms.scales[s].levels - 1),
+                nbins = ms.scales[s].p + 2,
+                cy = (y - b) * G / ih;
+            const unsigned char *lut = ms.luts[s].data();
+            unsigned int *row = counts[s].data() + cy * G * nbins;
+            for (int x = b; x < w - b; ++x)
+                ++row[cellOfColumn[s][x - b] * nbins + lut[code[s][x]]];
+        }
+    }
+
+    // Integral histogram over the finest cells, then the pyramid cells.
+    int offset = 0;
+    for (int s = 0; s < nbScales; ++s)
+    {
+        int
+            G = 1 << (ms.scales[s].levels - 1),
+            nbins = ms.scales[s].p + 2;
+        std::vector<unsigned int> integral((G + 1) * (G + 1) * nbins, 0);
+        auto I = [&](int i, int j) { return integral.data() + (j * (G + 1) + i) * nbins; };
+        for (int j = 0; j < G; ++j)
+            for (int i = 0; i < G; ++i)
+            {
+                const unsigned int *cell = counts[s].data() + (j * G + i) * nbins;
+                unsigned int
+                    *out = I(i + 1, j + 1),
+                    *left = I(i, j + 1),
+                    *up = I(i + 1, j),
+                    *diag = I(i, j);
+                for (int k = 0; k < nbins; ++k)
+                    out[k] = cell[k] + left[k] + up[k] - diag[k];
+            }
+
+        for (int l = 0; l < ms.scales[s].levels; ++l)
+        {
+            int n = 1 << l, span = G / n;
+            for (int j = 0; j < n; ++j)
+                for (int i = 0; i < n; ++i)
+                {
+                    const unsigned int
+                        *a = I(i * span, j * span),
+                        *bb = I((i + 1) * span, j * span),
+                        *c = I(i * span, (j + 1) * span),
+                        *d = I((i + 1) * span, (j + 1) * span);
+                    float *hist = descriptor.data() + offset, total = 0;
+                    for (int k = 0; k < nbins; ++k)
+                        total += hist[k] = (float)(d[k] - bb[k] - c[k] + a[k]);
+                    if (total > 0)
+                        for (int k = 0; k < nbins; ++k)
+                            hist[k] /= total;
+                    offset += nbins;
+                }
+        }
+    }
+    return descriptor;
+}
+
+/*
+  Descriptors of a batch of images, one image per thread at a time.
+  files     : Image files
+  ms        : Operator
+  nbThreads : Number of threads
+  Returns a (size x number of images) matrix, one descriptor per row.
+*/
+CImg<> BatchDescriptors(const std::vector<std::string> &files, const MultiScaleLBP &ms, unsigned int nbThreads)
+{
+    CImg<> descriptors(ms.size, (int)files.size(), 1, 1, 0);
+    std::atomic<int> next(0);
+    auto worker = [&]()
+    {
+        for (int i = next++; i < (int)files.size(); i = next++)
+        {
+            CImg<> img(files[i].c_str());
+            if (img.spectrum() == 4)
+                img.channels(0, 2);
+            img.norm();
+            descriptors.draw_image(0, i, MultiScaleDescriptor(img, ms));
+        }
+    };
+    nbThreads = std::max(1u, nbThreads);
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(worker);
+    for (auto &w : workers)
+        w.join();
+    return descriptors;
+}
+
+int main()
+{
+    std::vector<std::string> images = {
+        "cracked", "banded", "cobwebbed", "dotted", "bubbly", "fibrous",
+        "honeycombed", "grid", "spiralled", "chequered", "wrinkled", "braided"};
+    std::vector<std::string> files;
+    for (auto &image : images)
+        for (int i = 1; i <= 2; ++i)
+            files.push_back("../textures/" + image + std::to_string(i) + ".png");
+
+    // (R, p, pyramid levels) of each scale.
+    MultiScaleLBP ms = MakeMultiScaleLBP({{1, 8, 3}, {2, 16, 3}, {3, 24, 2}});
+    int nbShared = 0;
+    for (const Sample &sp : ms.samples)
+        nbShared += (int)sp.uses.size() - 1;
+    std::cout << "Descriptor size: " << ms.size << ", sampling points: " << ms.samples.size()
+              << " (" << nbShared << " shared between scales)" << std::endl;
+
+    unsigned int nbThreads = std::max(1u, std::thread::hardware_concurrency());
+    auto start = std::chrono::steady_clock::now();
+    CImg<> descriptors = BatchDescriptors(files, ms, nbThreads);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << files.size() << " images in " << elapsed.count() * 1000 << " ms ("
+              << files.size() / elapsed.count() << " images/s, " << nbThreads << " threads)" << std::endl;
+
+    // Nearest neighbor (L1) of each first image among the second images.
+    int nbCorrect = 0;
+    for (int i = 0; i < (int)files.size(); i += 2)
+    {
+        int best = -1;
+        float bestDistance = 0;
+        for (int j = 1; j < (int)files.size(); j += 2)
+        {
+            float d = (descriptors.get_row(i) - descriptors.get_row(j)).abs().sum();
+            if (best < 0 || d < bestDistance)
+            {
+                best = j;
+                bestDistance = d;
+            }
+        }
+        nbCorrect += best == i + 1;
+    }
+    std::cout << "Top-1 accuracy: " << nbCorrect << "/" << images.size() << std::endl;
+
+    descriptors.save("./results/textures_lbp_multiscale.cimg");
+
+    return 0;
+}
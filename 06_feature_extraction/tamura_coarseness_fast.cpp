@@ -0,0 +1,174 @@
+/*
+    Tamura coarseness coefficients, streamed row by row
+
+    tamura_coarseness.cpp stores the local means Ak and the differences Ekh
+    and Ekv of every scale as W x H x 5 volumes. Here the integral image is
+    built once in double precision, with a zero first row and column so that
+    the box sums need no test. Each row then computes, for every scale, the
+    means of the rows y - 2^k, y and y + 2^k, the differences, and the best
+    scale of each pixel, so the only buffers are a few rows per scale. Rows
+    are split into bands processed in parallel.
+*/
+
+#define cimg_use_png
+#include "CImg.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+using namespace cimg_library;
+
+/*
+  Integral image with a zero first row and column: I(x, y) is the sum of the
+  pixels in [0, x - 1] x [0, y - 1].
+  imgIn : Input image (first channel)
+*/
+CImg<double> IntegralImage(const CImg<> &imgIn)
+{
+    int
+        w = imgIn.width(),
+        h = imgIn.height();
+    CImg<double> I(w + 1, h + 1, 1, 1, 0);
+    for (int y = 0; y < h; ++y)
+    {
+        const float *in = imgIn.data(0, y);
+        const double *up = I.data(0, y);
+        double *out = I.data(0, y + 1), rowSum = 0;
+        for (int x = 0; x < w; ++x)
+        {
+            rowSum += in[x];
+            out[x + 1] = up[x + 1] + rowSum;
+        }
+    }
+    return I;
+}
+
+/*
+  Means of a row in windows of size 2 * k2, clipped to the image as in
+  IntegralMean of tamura_coarseness.cpp.
+  I      : Integral image
+  y      : Row
+  k2     : Half size of the window
+  x0, x1 : Clipped columns of the window of each pixel (x1 exclusive)
+  mean   : Output row
+*/
+void BoxMeanRow(const CImg<double> &I, int y, int k2,
+                const std::vector<int> &x0, const std::vector<int> &x1, std::vector<double> &mean)
+{
+    int
+        w = I.width() - 1,
+        h = I.height() - 1,
+        y0 = std::max(0, y - k2),
+        y1 = std::min(h, y + k2);
+    const double
+        *top = I.data(0, y0),
+        *bottom = I.data(0, y1);
+    double height = y1 - y0;
+    for (int x = 0; x < w; ++x)
+        mean[x] = (bottom[x1[x]] - bottom[x0[x]] - top[x1[x]] + top[x0[x]]) / (height * (x1[x] - x0[x]));
+}
+
+/*
+  Tamura's coarseness.
+  imgIn     : Input image (first channel)
+  nbScales  : Number of scales (window sizes 2, 4, ..., 2^nbScales)
+  nbThreads : Number of threads (rows are split into bands)
+*/
+float CoarsenessFast(const CImg<> &imgIn, int nbScales, unsigned int nbThreads)
+{
+    int
+        w = imgIn.width(),
+        h = imgIn.height();
+    CImg<double> I = IntegralImage(imgIn);
+
+    // Clipped window columns of each scale, shared by all the rows.
+    std::vector<std::vector<int>> x0(nbScales, std::vector<int>(w)), x1(x0);
+    for (int k = 0; k < nbScales; ++k)
+    {
+        int k2 = 1 << k;
+        for (int x = 0; x < w; ++x)
+        {
+            x0[k][x] = std::max(0, x - k2);
+            x1[k][x] = std::min(w, x + k2);
+        }
+    }
+
+    nbThreads = std::max(1u, nbThreads);
+    std::vector<double> partial(nbThreads, 0);
+    auto band = [&, w, h, nbScales](int yStart, int yEnd, unsigned int t)
+    {
+        std::vector<double> center(w), up(w), down(w);
+        std::vector<float> maxE(w);
+        std::vector<int> maxk(w);
+        double sum = 0;
+        for (int y = yStart; y < yEnd; ++y)
+        {
+            std::fill(maxE.begin(), maxE.end(), 0.0f);
+            std::fill(maxk.begin(), maxk.end(), 0);
+            for (int k = 0; k < nbScales; ++k)
+            {
+                int k2 = 1 << k;
+                BoxMeanRow(I, y, k2, x0[k], x1[k], center);
+                bool vertical = y - k2 >= 0 && y + k2 < h;
+                if (vertical)
+                {
+                    BoxMeanRow(I, y - k2, k2, x0[k], x1[k], up);
+                    BoxMeanRow(I, y + k2, k2, x0[k], x1[k], down);
+                }
+                for (int x = 0; x < w; ++x)
+                {
+                    float
+                        Eh = x - k2 >= 0 && x + k2 < w ? (float)std::abs(center[x + k2] - center[x - k2]) : 0,
+                        Ev = vertical ? (float)std::abs(down[x] - up[x]) : 0,
+                        E = std::max(Eh, Ev);
+                    if (E > maxE[x])
+                    {
+                        maxE[x] = E;
+                        maxk[x] = k + 1;
+                    }
+                }
+            }
+            for (int x = 0; x < w; ++x)
+                sum += 1 << maxk[x];
+        }
+        partial[t] = sum;
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(band, h * t / nbThreads, h * (t + 1) / nbThreads, t);
+    for (auto &wk : workers)
+        wk.join();
+
+    double sum = 0;
+    for (double s : partial)
+        sum += s;
+    return (float)(sum / ((double)w * h));
+}
+
+int main()
+{
+    unsigned int nbThreads = std::max(1u, std::thread::hardware_concurrency());
+    CImg<> imgIn("../images/farm.png");
+
+    auto start = std::chrono::steady_clock::now();
+    float coarseness = CoarsenessFast(imgIn, 5, nbThreads);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Coarseness: " << coarseness << " (" << elapsed.count() * 1000 << " ms, "
+              << nbThreads << " threads)" << std::endl;
+
+    std::cout << "Coarseness (smooth): " << CoarsenessFast(imgIn.get_blur(5.0f), 5, nbThreads) << std::endl;
+
+    // Large image: the memory no longer grows with the number of scales.
+    CImg<> large = imgIn.get_resize(4096, 4096, 1, 1, 3);
+    start = std::chrono::steady_clock::now();
+    coarseness = CoarsenessFast(large, 5, nbThreads);
+    elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Coarseness (4096x4096): " << coarseness << " (" << elapsed.count() * 1000 << " ms)" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,352 @@
+/*
+    Tamura features (Tamura et al., 1978) in a single traversal
+
+    tamura_coarseness.cpp, tamura_contrast.cpp and tamura_directionality.cpp
+    each load the image and make their own passes. Here the three features
+    are computed in the same sweep over the rows, after the integral image:
+    - coarseness, from the box means of each scale (tamura_coarseness_fast.cpp),
+    - contrast, from the central moments of each row, merged with the
+      pairwise formulas of Pebay (2008), which stay accurate when the mean is
+      large compared to the spread,
+    - directionality, from an orientation histogram of the centered gradient.
+    Rows are split into bands, and a batch of images is processed in parallel.
+*/
+
+#define cimg_use_png
+#include "CImg.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+using namespace cimg_library;
+
+struct TamuraFeatures
+{
+    float coarseness, contrast, directionality;
+};
+
+// Count, mean and central sums of order 2, 3 and 4 of a sample.
+struct Moments
+{
+    double n, mean, M2, M3, M4;
+};
+
+/*
+  Moments of the union of two samples (Pebay, 2008).
+*/
+Moments Merge(const Moments &a, const Moments &b)
+{
+    if (a.n == 0)
+        return b;
+    if (b.n == 0)
+        return a;
+    double
+        n = a.n + b.n,
+        d = b.mean - a.mean,
+        d2 = d * d,
+        nab = a.n * b.n;
+    Moments m;
+    m.n = n;
+    m.mean = a.mean + d * b.n / n;
+    m.M2 = a.M2 + b.M2 + d2 * nab / n;
+    m.M3 = a.M3 + b.M3 + d2 * d * nab * (a.n - b.n) / (n * n) + 3 * d * (a.n * b.M2 - b.n * a.M2) / n;
+    m.M4 = a.M4 + b.M4 + d2 * d2 * nab * (a.n * a.n - nab + b.n * b.n) / (n * n * n) +
+           6 * d2 * (a.n * a.n * b.M2 + b.n * b.n * a.M2) / (n * n) + 4 * d * (a.n * b.M3 - b.n * a.M3) / n;
+    return m;
+}
+
+/*
+  Moments of a row, computed around the mean of the row.
+*/
+Moments RowMoments(const float *v, int w)
+{
+    double sum = 0;
+    for (int x = 0; x < w; ++x)
+        sum += v[x];
+    double mean = sum / w, M2 = 0, M3 = 0, M4 = 0;
+    for (int x = 0; x < w; ++x)
+    {
+        double d = v[x] - mean, d2 = d * d;
+        M2 += d2;
+        M3 += d2 * d;
+        M4 += d2 * d2;
+    }
+    return {(double)w, mean, M2, M3, M4};
+}
+
+/*
+  Integral image with a zero first row and column.
+  imgIn : Input image (first channel)
+*/
+CImg<double> IntegralImage(const CImg<> &imgIn)
+{
+    int
+        w = imgIn.width(),
+        h = imgIn.height();
+    CImg<double> I(w + 1, h + 1, 1, 1, 0);
+    for (int y = 0; y < h; ++y)
+    {
+        const float *in = imgIn.data(0, y);
+        const double *up = I.data(0, y);
+        double *out = I.data(0, y + 1), rowSum = 0;
+        for (int x = 0; x < w; ++x)
+        {
+            rowSum += in[x];
+            out[x + 1] = up[x + 1] + rowSum;
+        }
+    }
+    return I;
+}
+
+/*
+  Means of a row in windows of size 2 * k2, clipped to the image.
+  I      : Integral image
+  y      : Row
+  k2     : Half size of the window
+  x0, x1 : Clipped columns of the window of each pixel (x1 exclusive)
+  mean   : Output row
+*/
+void BoxMeanRow(const CImg<double> &I, int y, int k2,
+                const std::vector<int> &x0, const std::vector<int> &x1, std::vector<double> &mean)
+{
+    int
+        w = I.width() - 1,
+        h = I.height() - 1,
+        y0 = std::max(0, y - k2),
+        y1 = std::min(h, y + k2);
+    const double
+        *top = I.data(0, y0),
+        *bottom = I.data(0, y1);
+    double height = y1 - y0;
+    for (int x = 0; x < w; ++x)
+        mean[x] = (bottom[x1[x]] - bottom[x0[x]] - top[x1[x]] + top[x0[x]]) / (height * (x1[x] - x0[x]));
+}
+
+/*
+  Directionality of an orientation histogram, as in tamura_directionality.cpp:
+  the bins above 70% of the maximum are the peaks, and the spread of the
+  histogram around them is penalized.
+*/
+float DirectionalityFromHistogram(CImg<> h)
+{
+    h.threshold(0.7f * h.max());
+    int nb_pics = (int)h.sum();
+    CImg<int> perm;
+    h.get_sort(perm, false);
+    float D = 0;
+    for (int p = 0; p < nb_pics; ++p)
+        cimg_forX(h, x) D -= h(x) * (cimg::sqr(x - perm(p)));
+    float r = 1;
+    D *= r * nb_pics;
+    return D + 1;
+}
+
+/*
+  Tamura's coarseness, contrast and directionality of an image.
+  imgIn     : Input image (first channel)
+  n         : Power of the kurtosis in the contrast
+  nbThreads : Number of threads (rows are split into bands)
+*/
+TamuraFeatures Tamura(const CImg<> &imgIn, float n, unsigned int nbThreads)
+{
+    const int nbScales = 5, nbBins = 90;
+    const float tau = 0.01f;
+    int
+        w = imgIn.width(),
+        h = imgIn.height();
+    CImg<double> I = IntegralImage(imgIn);
+
+    std::vector<std::vector<int>> x0(nbScales, std::vector<int>(w)), x1(x0);
+    for (int k = 0; k < nbScales; ++k)
+        for (int x = 0; x < w; ++x)
+        {
+            x0[k][x] = std::max(0, x - (1 << k));
+            x1[k][x] = std::min(w, x + (1 << k));
+        }
+
+    // Per-thread partial results.
+    nbThreads = std::max(1u, nbThreads);
+    std::vector<double> coarseness(nbThreads, 0);
+    std::vector<Moments> moments(nbThreads, Moments{0, 0, 0, 0, 0});
+    std::vector<CImg<>> histograms(nbThreads, CImg<>(nbBins, 1, 1, 1, 0));
+
+    auto band = [&, w, h](int yStart, int yEnd, unsigned int t)
+    {
+        std::vector<double> center(w), up(w), down(w);
+        std::vector<float> maxE(w);
+        std::vector<int> maxk(w);
+        float *hist = histograms[t].data();
+        for (int y = yStart; y < yEnd; ++y)
+        {
+            const float *row = imgIn.data(0, y);
+
+            // Coarseness: best scale of each pixel.
+            std::fill(maxE.begin(), maxE.end(), 0.0f);
+            std::fill(maxk.begin(), maxk.end(), 0);
+            for (int k = 0; k < nbScales; ++k)
+            {
+                int k2 = 1 << k;
+                BoxMeanRow(I, y, k2, x0[k], x1[k], center);
+                bool vertical = y - k2 >= 0 && y + k2 < h;
+                if (vertical)
+                {
+                    BoxMeanRow(I, y - k2, k2, x0[k], x1[k], up);
+                    BoxMeanRow(I, y + k2, k2, x0[k], x1[k], down);
+                }
+                for (int x = 0; x < w; ++x)
+                {
+                    float
+                        Eh = x - k2 >= 0 && x + k2 < w ? (float)std::abs(center[x + k2] - center[x - k2]) : 0,
+                        Ev = vertical ? (float)std::abs(down[x] - up[x]) : 0,
+                        E = std::max(Eh, Ev);
+                    if (E > maxE[x])
+                    {
+                        maxE[x] = E;
+                        maxk[x] = k + 1;
+                    }
+                }
+            }
+            for (int x = 0; x < w; ++x)
+                coarseness[t] += 1 << maxk[x];
+
+            // Contrast: moments of the row.
+            moments[t] = Merge(moments[t], RowMoments(row, w));
+
+            // Directionality: centered differences with Neumann boundaries,
+            // weak gradients are left out of the histogram.
+            const float
+                *prev = imgIn.data(0, std::max(0, y - 1)),
+                *next = imgIn.data(0, std::min(h - 1, y + 1));
+            for (int x = 0; x < w; ++x)
+            {
+                float
+                    gx = (row[std::min(w - 1, x + 1)] - row[std::max(0, x - 1)]) / 2,
+                    gy = (next[x] - prev[x]) / 2;
+                if (gx * gx + gy * gy > tau * tau)
+                {
+                    int bin = (int)((std::atan2(gy, gx) + cimg::PI) * nbBins / (2 * cimg::PI));
+                    ++hist[std::min(bin, nbBins - 1)];
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(band, h * t / nbThreads, h * (t + 1) / nbThreads, t);
+    for (auto &wk : workers)
+        wk.join();
+
+    double S = 0;
+    Moments m = {0, 0, 0, 0, 0};
+    CImg<> hist(nbBins, 1, 1, 1, 0);
+    for (unsigned int t = 0; t < nbThreads; ++t)
+    {
+        S += coarseness[t];
+        m = Merge(m, moments[t]);
+        hist += histograms[t];
+    }
+
+    TamuraFeatures f;
+    f.coarseness = (float)(S / m.n);
+    double variance = m.n > 1 ? m.M2 / (m.n - 1) : 0;
+    double kurtosis = variance > 0 ? m.M4 / (m.n * variance * variance) : 0;
+    f.contrast = kurtosis > 0 ? (float)(std::sqrt(variance) / std::pow(kurtosis, n)) : 0;
+    f.directionality = DirectionalityFromHistogram(hist / (float)m.n);
+    return f;
+}
+
+/*
+  Tamura features of a batch of images, one image per thread at a time.
+  files     : Image files
+  n         : Power of the kurtosis in the contrast
+  nbThreads : Number of threads
+*/
+std::vector<TamuraFeatures> BatchTamura(const std::vector<std::string> &files, float n, unsigned int nbThreads)
+{
+    std::vector<TamuraFeatures> features(files.size());
+    std::atomic<int> next(0);
+    auto worker = [&]()
+    {
+        for (int i = next++; i < (int)files.size(); i = next++)
+        {
+            CImg<> img(files[i].c_str());
+            if (img.spectrum() == 4)
+                img.channels(0, 2);
+            img.norm();
+            features[i] = Tamura(img, n, 1);
+        }
+    };
+    nbThreads = std::max(1u, nbThreads);
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(worker);
+    for (auto &wk : workers)
+        wk.join();
+    return features;
+}
+
+/*
+  Saves the features, as text with the file names if the extension is .csv,
+  otherwise as a 3 x N float image in any format supported by CImg (.cimg).
+  files    : Image files
+  features : Features of the images
+  filename : Output file
+*/
+void SaveFeatures(const std::vector<std::string> &files, const std::vector<TamuraFeatures> &features,
+                  const std::string &filename)
+{
+    if (!cimg::strcasecmp(cimg::split_filename(filename.c_str()), "csv"))
+    {
+        std::ofstream out(filename);
+        if (!out)
+            throw CImgIOException("SaveFeatures(): Failed to open file '%s'.", filename.c_str());
+        out << "file,coarseness,contrast,directionality\n";
+        for (size_t i = 0; i < files.size(); ++i)
+            out << files[i] << "," << features[i].coarseness << "," << features[i].contrast << ","
+                << features[i].directionality << "\n";
+        return;
+    }
+    CImg<> matrix(3, (int)features.size());
+    for (int i = 0; i < (int)features.size(); ++i)
+    {
+        matrix(0, i) = features[i].coarseness;
+        matrix(1, i) = features[i].contrast;
+        matrix(2, i) = features[i].directionality;
+    }
+    matrix.save(filename.c_str());
+}
+
+int main()
+{
+    std::vector<std::string> images = {
+        "cracked", "banded", "cobwebbed", "dotted", "bubbly", "fibrous",
+        "honeycombed", "grid", "spiralled", "chequered", "wrinkled", "braided"};
+    std::vector<std::string> files;
+    for (auto &image : images)
+        for (int i = 1; i <= 2; ++i)
+            files.push_back("../textures/" + image + std::to_string(i) + ".png");
+
+    unsigned int nbThreads = std::max(1u, std::thread::hardware_concurrency());
+    auto start = std::chrono::steady_clock::now();
+    std::vector<TamuraFeatures> features = BatchTamura(files, 0.5f, nbThreads);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    for (size_t i = 0; i < files.size(); ++i)
+        std::cout << files[i] << ": coarseness = " << features[i].coarseness << ", contrast = "
+                  << features[i].contrast << ", directionality = " << features[i].directionality << std::endl;
+    std::cout << files.size() << " images in " << elapsed.count() * 1000 << " ms (" << nbThreads
+              << " threads)" << std::endl;
+
+    SaveFeatures(files, features, "./results/tamura_features.csv");
+    SaveFeatures(files, features, "./results/tamura_features.cimg");
+
+    return 0;
+}
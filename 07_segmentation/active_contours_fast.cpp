@@ -0,0 +1,409 @@
+/*
+    Narrow-band active contours (geodesic model)
+
+    active_contours.cpp computes two gradients of the whole level-set
+    function and updates every pixel at each iteration, although only the
+    pixels near the zero level set move the contour. Here, the level-set
+    function is only updated in a narrow band of half-width W around the
+    contour:
+    - The speed function f of the geodesic model and its gradient are
+      computed once. The upwind differences of psi are computed locally, for
+      the pixels of the band only.
+    - Outside the band, psi is clamped to -W or W. The pixels at the edge of
+      the band are flagged: when the contour comes within one pixel of one of
+      them, or every reinitPeriod iterations, psi is reinitialized.
+    - The reinitialization is a fast marching from the zero level set, which
+      stops at distance W. It visits the pixels of the new band only, and
+      restores psi to a signed distance.
+    The cost of an iteration is proportional to the length of the contour
+    instead of the area of the image.
+*/
+
+#define cimg_use_png
+#include "CImg.h"
+
+#include <queue>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+#include <utility>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+using namespace cimg_library;
+
+// Parameters of the geodesic model, with the values of active_contours.cpp.
+struct ContourParams
+{
+    float deltaT = 2.0f;      // Temporal step
+    float alpha = 0.03f;      // Weighting of the propagation term
+    float beta = 1.0f;        // Weighting of the advection term
+    float balloon = 0.01f;    // Balloon force (>0)
+    int expansion = 1;        // Expansion (1) or contraction (-1) of F0
+    int nbIterations = 400;   // Number of iterations
+    float bandWidth = 4;      // Half-width W of the narrow band
+    int reinitPeriod = 20;    // Iterations between two reinitializations
+};
+
+// Level-set function restricted to a narrow band.
+struct NarrowBand
+{
+    CImg<> psi;                  // Level-set function, clamped to [-W, W]
+    std::vector<int> band;       // Offsets of the pixels with |psi| < W
+    CImg<unsigned char> edge;    // Pixels at the edge of the band
+    CImg<> distance;             // Fast marching distances (infinite outside)
+    CImg<unsigned char> state;   // Fast marching states
+    int reinitializations = 0;
+};
+
+/*
+  Speed function of the geodesic model and its gradient, as in Propagate.
+  imgIn  : Image to be segmented
+  params : Parameters of the model
+  f      : Output, speed function
+  gradF  : Output, gradient of f
+*/
+void GeodesicSpeed(const CImg<> &imgIn, const ContourParams &params, CImg<> &f, CImgList<> &gradF)
+{
+    CImgList<> gradImg = imgIn.get_gradient("xy", 4);
+    f.assign(imgIn.width(), imgIn.height());
+    cimg_forXY(f, x, y)
+    {
+        float
+            gx = gradImg(0, x, y),
+            gy = gradImg(1, x, y);
+        f(x, y) = params.expansion * (1. / (1 + std::sqrt(gx * gx + gy * gy)) + params.balloon);
+    }
+    gradF = f.get_gradient();
+}
+
+/*
+  Reinitialization of psi to a signed distance in the band, by fast marching
+  from the zero level set. The pixels next to a sign change get the distance
+  to the crossing interpolated along the grid, the others are reached in
+  increasing order of distance, each one solving the upwind Eikonal equation
+  |grad d| = 1 from its accepted neighbors, up to W.
+  nb         : Narrow band, updated
+  candidates : Pixels where the zero level set is searched
+  W          : Half-width of the band
+*/
+void Reinitialize(NarrowBand &nb, const std::vector<int> &candidates, float W)
+{
+    CImg<> &psi = nb.psi, &d = nb.distance;
+    CImg<unsigned char> &state = nb.state;
+    int w = psi.width(), h = psi.height();
+    const float inf = std::numeric_limits<float>::infinity();
+    const int far = 0, trial = 1, accepted = 2;
+
+    // Distances to the zero level set, for the pixels next to it.
+    typedef std::pair<float, int> Item;
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item>> heap;
+    std::vector<int> touched;
+    for (int i : candidates)
+    {
+        int x = i % w, y = i / w;
+        float p = psi[i], best = p == 0 ? 0 : inf;
+        int neighbors[4] = {x > 0 ? i - 1 : -1, x < w - 1 ? i + 1 : -1, y > 0 ? i - w : -1, y < h - 1 ? i + w : -1};
+        for (int j : neighbors)
+            if (j >= 0 && p * psi[j] < 0)
+                best = std::min(best, p / (p - psi[j]));
+        if (best < inf)
+        {
+            d[i] = best;
+            state[i] = trial;
+            touched.push_back(i);
+            heap.push(Item(best, i));
+        }
+    }
+
+    // Fast marching, on both sides of the contour at once.
+    std::vector<int> band;
+    while (!heap.empty())
+    {
+        Item item = heap.top();
+        heap.pop();
+        int i = item.second;
+        if (state[i] == accepted || item.first > d[i])
+            continue;
+        state[i] = accepted;
+        band.push_back(i);
+        int x = i % w, y = i / w;
+        int neighbors[4] = {x > 0 ? i - 1 : -1, x < w - 1 ? i + 1 : -1, y > 0 ? i - w : -1, y < h - 1 ? i + w : -1};
+        for (int j : neighbors)
+        {
+            if (j < 0 || state[j] == accepted)
+                continue;
+            int xj = j % w, yj = j / w;
+            float
+                a = std::min(xj > 0 && state[j - 1] == accepted ? d[j - 1] : inf,
+                             xj < w - 1 && state[j + 1] == accepted ? d[j + 1] : inf),
+                b = std::min(yj > 0 && state[j - w] == accepted ? d[j - w] : inf,
+                             yj < h - 1 && state[j + w] == accepted ? d[j + w] : inf),
+                t = std::abs(a - b) >= 1 ? std::min(a, b) + 1 : (a + b + std::sqrt(2 - (a - b) * (a - b))) / 2;
+            if (t < W && t < d[j])
+            {
+                if (state[j] == far)
+                    touched.push_back(j);
+                d[j] = t;
+                state[j] = trial;
+                heap.push(Item(t, j));
+            }
+        }
+    }
+
+    // Pixels that leave the band are clamped, the others get their signed
+    // distance, and the states are reset.
+    for (int i : nb.band)
+        if (state[i] != accepted)
+        {
+            psi[i] = psi[i] < 0 ? -W : W;
+            nb.edge[i] = 0;
+        }
+    for (int i : band)
+    {
+        psi[i] = psi[i] < 0 ? -d[i] : d[i];
+        nb.edge[i] = d[i] >= W - 1;
+    }
+    for (int i : touched)
+    {
+        state[i] = far;
+        d[i] = inf;
+    }
+    nb.band.swap(band);
+    ++nb.reinitializations;
+}
+
+/*
+  Narrow band of a level-set function defined on the whole image: psi is
+  clamped outside the band after a first fast marching over all the pixels.
+  LevelSet : Level-set function (initialized)
+  W        : Half-width of the band
+*/
+NarrowBand InitNarrowBand(const CImg<> &LevelSet, float W)
+{
+    NarrowBand nb;
+    nb.psi = LevelSet;
+    nb.edge.assign(LevelSet.width(), LevelSet.height(), 1, 1, 0);
+    nb.distance.assign(LevelSet.width(), LevelSet.height(), 1, 1, std::numeric_limits<float>::infinity());
+    nb.state.assign(LevelSet.width(), LevelSet.height(), 1, 1, 0);
+    std::vector<int> all((size_t)LevelSet.size());
+    for (size_t i = 0; i < all.size(); ++i)
+        all[i] = (int)i;
+    cimg_foroff(nb.psi, i) nb.psi[i] = std::max(-W, std::min(W, nb.psi[i]));
+    Reinitialize(nb, all, W);
+    return nb;
+}
+
+/*
+  Propagation of the contour in the narrow band (geodesic model). The
+  updates of an iteration are computed from the previous values of psi, then
+  applied, as in Propagate.
+  nb     : Narrow band, updated
+  f      : Speed function
+  gradF  : Gradient of f
+  params : Parameters of the model
+*/
+void PropagateNarrowBand(NarrowBand &nb, const CImg<> &f, const CImgList<> &gradF, const ContourParams &params)
+{
+    CImg<> &psi = nb.psi;
+    int w = psi.width(), h = psi.height();
+    float W = params.bandWidth, dt = params.deltaT;
+    const float *F = f.data(), *U = gradF[0].data(), *V = gradF[1].data();
+    std::vector<float> updates;
+    for (int iter = 0; iter < params.nbIterations; ++iter)
+    {
+        updates.resize(nb.band.size());
+        for (size_t n = 0; n < nb.band.size(); ++n)
+        {
+            int i = nb.band[n], x = i % w, y = i / w;
+            const float *p = psi.data() + i;
+            // Upwind differences, with Neumann boundaries as get_gradient.
+            float
+                Dxm = x > 0 ? p[0] - p[-1] : 0,
+                Dxp = x < w - 1 ? p[1] - p[0] : 0,
+                Dym = y > 0 ? p[0] - p[-w] : 0,
+                Dyp = y < h - 1 ? p[w] - p[0] : 0;
+            float
+                Nabla_plus = std::sqrt(cimg::sqr(std::max(Dxm, 0.0f)) + cimg::sqr(std::min(Dxp, 0.0f)) +
+                                       cimg::sqr(std::max(Dym, 0.0f)) + cimg::sqr(std::min(Dyp, 0.0f))),
+                Nabla_minus = std::sqrt(cimg::sqr(std::max(Dxp, 0.0f)) + cimg::sqr(std::min(Dxm, 0.0f)) +
+                                        cimg::sqr(std::max(Dyp, 0.0f)) + cimg::sqr(std::min(Dym, 0.0f))),
+                Fprop = -(std::max(F[i], 0.0f) * Nabla_plus + std::min(F[i], 0.0f) * Nabla_minus),
+                Fadv = -(std::max(U[i], 0.0f) * Dxm + std::min(U[i], 0.0f) * Dxp +
+                         std::max(V[i], 0.0f) * Dym + std::min(V[i], 0.0f) * Dyp);
+            updates[n] = dt * (params.alpha * Fprop + params.beta * Fadv);
+        }
+
+        // The contour coming close to the edge of the band triggers a
+        // reinitialization before the next iteration.
+        bool reinit = !((iter + 1) % params.reinitPeriod);
+        for (size_t n = 0; n < nb.band.size(); ++n)
+        {
+            int i = nb.band[n];
+            float value = std::max(-W, std::min(W, psi[i] + updates[n]));
+            psi[i] = value;
+            if (nb.edge[i] && std::abs(value) < 1)
+                reinit = true;
+        }
+        if (reinit)
+        {
+            std::vector<int> candidates = nb.band;
+            Reinitialize(nb, candidates, W);
+        }
+    }
+}
+
+/*
+    DrawLevelSet: Draw the zero level-set of the function psi
+    (copied from active_contours.cpp)
+*/
+CImg<> drawLevelSet(CImg<> &LevelSet)
+{
+    CImg<> imgOut(LevelSet.width(), LevelSet.height(), 1, 3);
+    imgOut.fill(0);
+    cimg_forXY(imgOut, x, y)
+    {
+        if (LevelSet(x, y) < 0)
+            imgOut(x, y, 0) = 255;
+        else
+            imgOut(x, y, 2) = 255;
+    }
+    return imgOut;
+}
+
+/*
+    InitLevelSet: Initialization of the LevelSet (psi) using the
+    signed euclidean distance (copied from active_contours.cpp)
+*/
+void InitLevelSet(CImg<> &imgIn, int x0, int y0, int r)
+{
+    cimg_forXY(imgIn, x, y)
+        imgIn(x, y) = std::sqrt(cimg::sqr(x - x0) + cimg::sqr(y - y0)) - r;
+}
+
+/*
+  Reference implementation, copied from active_contours.cpp for the
+  benchmark (without the debug drawing, and with the number of iterations
+  as a parameter).
+*/
+void Propagate(CImg<> &imgIn, CImg<> &LevelSet, int nbiter)
+{
+    float
+        delta_t = 2.0f, // Temporal step
+        alpha = 0.03f,  // Weighting of the propagation term
+        beta = 1.0f,    // Weighting of the advection term
+        ballon = 0.01f; // Balloon force (>0)
+    int
+        exp_cont = 1; // Expansion (1) or contraction (-1) of F0
+
+    CImgList<> GradImg = imgIn.get_gradient("xy", 4);
+    CImg<> f(imgIn.width(), imgIn.height());
+    cimg_forXY(f, x, y)
+    {
+        float
+            gx = GradImg(0, x, y),
+            gy = GradImg(1, x, y);
+        f(x, y) = exp_cont * (1. / (1 + std::sqrt(gx * gx + gy * gy)) + ballon);
+    }
+    CImgList<> Grad_f = f.get_gradient();
+
+    for (int iter = 0; iter < nbiter; ++iter)
+    {
+        CImgList<>
+            GradLS_minus = LevelSet.get_gradient("xy", -1),
+            GradLS_plus = LevelSet.get_gradient("xy", 1);
+        cimg_forXY(LevelSet, x, y)
+        {
+            float
+                Dxm = GradLS_minus(0, x, y),
+                Dxp = GradLS_plus(0, x, y),
+                Dym = GradLS_minus(1, x, y),
+                Dyp = GradLS_plus(1, x, y);
+            float
+                Nabla_plus = std::sqrt(cimg::sqr(std::max(Dxm, 0.0f)) +
+                                       cimg::sqr(std::min(Dxp, 0.0f)) +
+                                       cimg::sqr(std::max(Dym, 0.0f)) +
+                                       cimg::sqr(std::min(Dyp, 0.0f))),
+                Nabla_minus = std::sqrt(cimg::sqr(std::max(Dxp, 0.0f)) +
+                                        cimg::sqr(std::min(Dxm, 0.0f)) +
+                                        cimg::sqr(std::max(Dyp, 0.0f)) +
+                                        cimg::sqr(std::min(Dym, 0.0f))),
+                Fprop = -(std::max(f(x, y), 0.0f) * Nabla_plus + std::min(f(x, y), 0.0f) * Nabla_minus);
+            float
+                u = Grad_f(0, x, y),
+                v = Grad_f(1, x, y),
+                Fadv = -(std::max(u, 0.0f) * Dxm + std::min(u, 0.0f) * Dxp +
+                         std::max(v, 0.0f) * Dym + std::min(v, 0.0f) * Dyp);
+            LevelSet(x, y) += delta_t * (alpha * Fprop + beta * Fadv);
+        }
+        if (!(iter % 20))
+            LevelSet.distance_eikonal(10, 3);
+    }
+}
+
+int main()
+{
+    CImg<> imgIn("../images/coins.png");
+    imgIn.norm().blur(0.75).threshold(imgIn.median() + 30).blur_median(3.0f);
+    CImg<> input = imgIn.get_resize(256, 128);
+    ContourParams params;
+
+    // Same setting as active_contours.cpp.
+    CImg<> LevelSet(input.width(), input.height()), reference(LevelSet);
+    InitLevelSet(LevelSet, 192, 77, 10);
+    reference = LevelSet;
+    auto t0 = std::chrono::steady_clock::now();
+    CImg<> f;
+    CImgList<> gradF;
+    GeodesicSpeed(input, params, f, gradF);
+    NarrowBand nb = InitNarrowBand(LevelSet, params.bandWidth);
+    PropagateNarrowBand(nb, f, gradF, params);
+    auto t1 = std::chrono::steady_clock::now();
+    Propagate(input, reference, params.nbIterations);
+    auto t2 = std::chrono::steady_clock::now();
+    int inside = 0, different = 0;
+    cimg_foroff(reference, i)
+    {
+        inside += reference[i] < 0;
+        different += (reference[i] < 0) != (nb.psi[i] < 0);
+    }
+    std::cout << "256x128, " << params.nbIterations << " iterations: " << std::chrono::duration<double>(t1 - t0).count() * 1000
+              << " ms (" << nb.reinitializations << " reinitializations), active_contours.cpp: "
+              << std::chrono::duration<double>(t2 - t1).count() * 1000 << " ms, " << different
+              << " pixels on a different side of the contour (" << inside << " inside)" << std::endl;
+    drawLevelSet(nb.psi).save_png("./results/active_contours_fast.png");
+
+    // Scaling: the image and the contour are s times larger, so the area
+    // grows as s^2 and the length of the contour as s.
+    params.nbIterations = 100;
+    for (int s = 1; s <= 8; s *= 2)
+    {
+        input = imgIn.get_resize(256 * s, 128 * s);
+        LevelSet.assign(input.width(), input.height());
+        InitLevelSet(LevelSet, 192 * s, 77 * s, 10 * s);
+        reference = LevelSet;
+        t0 = std::chrono::steady_clock::now();
+        GeodesicSpeed(input, params, f, gradF);
+        nb = InitNarrowBand(LevelSet, params.bandWidth);
+        t1 = std::chrono::steady_clock::now();
+        PropagateNarrowBand(nb, f, gradF, params);
+        t2 = std::chrono::steady_clock::now();
+        std::cout << input.width() << "x" << input.height() << ": " << std::chrono::duration<double>(t2 - t1).count() * 1000 / params.nbIterations
+                  << " ms per iteration (" << nb.band.size() << " pixels in the band, setup "
+                  << std::chrono::duration<double>(t1 - t0).count() * 1000 << " ms)";
+        if (s <= 4)
+        {
+            t0 = std::chrono::steady_clock::now();
+            Propagate(input, reference, params.nbIterations);
+            t1 = std::chrono::steady_clock::now();
+            std::cout << ", active_contours.cpp: " << std::chrono::duration<double>(t1 - t0).count() * 1000 / params.nbIterations
+                      << " ms per iteration";
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,315 @@
+/*
+    Euclidean distance transforms, signed distances and fast marching
+
+    The exact Euclidean distance transform of a binary mask uses the
+    algorithm of Felzenszwalb and Huttenlocher (2012), in O(N):
+    - Along each column, the distance to the nearest feature pixel is given
+      by a forward and a backward scan. Both scans go over the rows, so they
+      run along contiguous memory, and the columns are split between threads.
+    - Along each row, the squared distance is the lower envelope of the
+      parabolas (x - q)^2 + g(q)^2 rooted at every pixel q of the row, built
+      in a single pass. Rows are split between threads.
+    The signed distance of a mask is negative inside and positive outside,
+    like the level-set function of active_contours.cpp. For non-uniform
+    speeds (such as the function f of the geodesic model), the arrival time
+    of a front is computed by fast marching.
+*/
+
+#define cimg_use_png
+#include "CImg.h"
+
+#include <queue>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+using namespace cimg_library;
+
+/*
+  Runs f(first, last) on nbThreads ranges splitting [0, n).
+*/
+template <typename F>
+void ParallelFor(int n, unsigned int nbThreads, F f)
+{
+    nbThreads = std::max(1u, std::min(nbThreads, (unsigned int)std::max(n, 1)));
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(f, (int)((long long)n * t / nbThreads), (int)((long long)n * (t + 1) / nbThreads));
+    for (auto &wk : workers)
+        wk.join();
+}
+
+/*
+  Lower envelope of the parabolas (q - p)^2 + f(p): squared distance
+  transform of a sampled function in 1D (Felzenszwalb-Huttenlocher).
+  f    : Input samples
+  n    : Number of samples
+  d    : Output, squared distances
+  v, z : Work buffers (n and n + 1 elements): roots of the parabolas of the
+         envelope, and boundaries between them
+*/
+void LowerEnvelope(const double *f, int n, double *d, int *v, double *z)
+{
+    const double inf = std::numeric_limits<double>::infinity();
+    int k = 0;
+    v[0] = 0;
+    z[0] = -inf;
+    z[1] = inf;
+    for (int q = 1; q < n; ++q)
+    {
+        double s = ((f[q] + (double)q * q) - (f[v[k]] + (double)v[k] * v[k])) / (2.0 * (q - v[k]));
+        while (s <= z[k])
+        {
+            --k;
+            s = ((f[q] + (double)q * q) - (f[v[k]] + (double)v[k] * v[k])) / (2.0 * (q - v[k]));
+        }
+        ++k;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = inf;
+    }
+    k = 0;
+    for (int q = 0; q < n; ++q)
+    {
+        while (z[k + 1] < q)
+            ++k;
+        d[q] = (double)(q - v[k]) * (q - v[k]) + f[v[k]];
+    }
+}
+
+/*
+  Exact Euclidean distance from each pixel to the nearest non-zero pixel of
+  the mask. If the mask has no non-zero pixel, the distances are larger
+  than the diagonal of the image.
+  mask      : Binary mask
+  nbThreads : Number of threads
+*/
+CImg<> DistanceTransform(const CImg<unsigned char> &mask, unsigned int nbThreads)
+{
+    int w = mask.width(), h = mask.height(), far = w + h;
+
+    // Distance along the columns, capped to w + h, which is larger than any
+    // distance to a feature pixel.
+    CImg<int> g(w, h);
+    ParallelFor(w, nbThreads, [&, w, h, far](int x0, int x1)
+    {
+        for (int x = x0; x < x1; ++x)
+            g(x, 0) = mask(x, 0) ? 0 : far;
+        for (int y = 1; y < h; ++y)
+        {
+            const unsigned char *m = mask.data(0, y);
+            const int *above = g.data(0, y - 1);
+            int *row = g.data(0, y);
+            for (int x = x0; x < x1; ++x)
+                row[x] = m[x] ? 0 : std::min(above[x] + 1, far);
+        }
+        for (int y = h - 2; y >= 0; --y)
+        {
+            const int *below = g.data(0, y + 1);
+            int *row = g.data(0, y);
+            for (int x = x0; x < x1; ++x)
+                row[x] = std::min(row[x], below[x] + 1);
+        }
+    });
+
+    // Lower envelope along the rows.
+    CImg<> distances(w, h);
+    ParallelFor(h, nbThreads, [&, w](int y0, int y1)
+    {
+        std::vector<double> f(w), d(w), z(w + 1);
+        std::vector<int> v(w);
+        for (int y = y0; y < y1; ++y)
+        {
+            const int *row = g.data(0, y);
+            for (int x = 0; x < w; ++x)
+                f[x] = (double)row[x] * row[x];
+            LowerEnvelope(f.data(), w, d.data(), v.data(), z.data());
+            float *out = distances.data(0, y);
+            for (int x = 0; x < w; ++x)
+                out[x] = (float)std::sqrt(d[x]);
+        }
+    });
+    return distances;
+}
+
+/*
+  Signed Euclidean distance to the boundary of a mask: negative inside,
+  positive outside. The boundary lies halfway between a pixel of the mask
+  and its nearest pixel outside, so the distance is the distance to the
+  nearest pixel on the other side minus 1/2.
+  mask      : Binary mask (non-zero inside)
+  nbThreads : Number of threads
+*/
+CImg<> SignedDistance(const CImg<unsigned char> &mask, unsigned int nbThreads)
+{
+    CImg<unsigned char> outside(mask.width(), mask.height());
+    cimg_foroff(mask, i) outside[i] = !mask[i];
+    CImg<> toInside = DistanceTransform(mask, nbThreads), toOutside = DistanceTransform(outside, nbThreads);
+    CImg<> signedDistance(mask.width(), mask.height());
+    cimg_foroff(mask, i) signedDistance[i] = mask[i] ? 0.5f - toOutside[i] : toInside[i] - 0.5f;
+    return signedDistance;
+}
+
+/*
+  Arrival time of a front starting from the seeds and moving at the given
+  speed, i.e. the solution of |grad T| = 1 / F, by fast marching: pixels are
+  accepted in increasing order of arrival time, each one solving the upwind
+  Eikonal equation from its accepted 4-neighbors. Pixels with a zero or
+  negative speed are never reached (infinite time).
+  speed : Speed F of the front (pixels per unit of time)
+  seeds : Non-zero at the starting pixels (T = 0)
+*/
+CImg<> FastMarching(const CImg<> &speed, const CImg<unsigned char> &seeds)
+{
+    int w = speed.width(), h = speed.height();
+    const float inf = std::numeric_limits<float>::infinity();
+    CImg<> T(w, h, 1, 1, inf);
+    CImg<unsigned char> accepted(w, h, 1, 1, 0);
+    typedef std::pair<float, int> Item;
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item>> heap;
+    cimg_foroff(seeds, i) if (seeds[i])
+    {
+        T[i] = 0;
+        heap.push(Item(0.0f, (int)i));
+    }
+
+    while (!heap.empty())
+    {
+        Item item = heap.top();
+        heap.pop();
+        int i = item.second;
+        if (accepted[i] || item.first > T[i])
+            continue;
+        accepted[i] = 1;
+        int x = i % w, y = i / w;
+        int neighbors[4] = {x > 0 ? i - 1 : -1, x < w - 1 ? i + 1 : -1, y > 0 ? i - w : -1, y < h - 1 ? i + w : -1};
+        for (int j : neighbors)
+        {
+            if (j < 0 || accepted[j] || speed[j] <= 0)
+                continue;
+            int xj = j % w, yj = j / w;
+            float
+                s = 1 / speed[j],
+                a = std::min(xj > 0 && accepted[j - 1] ? T[j - 1] : inf, xj < w - 1 && accepted[j + 1] ? T[j + 1] : inf),
+                b = std::min(yj > 0 && accepted[j - w] ? T[j - w] : inf, yj < h - 1 && accepted[j + w] ? T[j + w] : inf),
+                t = std::abs(a - b) >= s ? std::min(a, b) + s : (a + b + std::sqrt(2 * s * s - (a - b) * (a - b))) / 2;
+            if (t < T[j])
+            {
+                T[j] = t;
+                heap.push(Item(t, j));
+            }
+        }
+    }
+    return T;
+}
+
+int main()
+{
+    unsigned int nbThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Exactness: comparison with a brute-force search on random features.
+    std::mt19937 rng(42);
+    CImg<unsigned char> random(200, 150, 1, 1, 0);
+    std::vector<std::pair<int, int>> features;
+    for (int n = 0; n < 40; ++n)
+    {
+        int x = rng() % random.width(), y = rng() % random.height();
+        random(x, y) = 1;
+        features.push_back(std::make_pair(x, y));
+    }
+    CImg<> edt = DistanceTransform(random, nbThreads);
+    float maxError = 0;
+    cimg_forXY(random, x, y)
+    {
+        float best = std::numeric_limits<float>::infinity();
+        for (auto &p : features)
+            best = std::min(best, std::sqrt((float)((x - p.first) * (x - p.first) + (y - p.second) * (y - p.second))));
+        maxError = std::max(maxError, std::abs(best - edt(x, y)));
+    }
+    std::cout << "Maximal difference with a brute-force search: " << maxError << std::endl;
+
+    // Signed distance of a disk, against the analytic distance of
+    // InitLevelSet in active_contours.cpp.
+    CImg<unsigned char> disk(256, 128);
+    cimg_forXY(disk, x, y) disk(x, y) = std::sqrt(cimg::sqr(x - 192) + cimg::sqr(y - 77)) - 30 < 0;
+    CImg<> sd = SignedDistance(disk, nbThreads);
+    float diskError = 0;
+    cimg_forXY(sd, x, y)
+        diskError = std::max(diskError, std::abs(sd(x, y) - (std::sqrt((float)(cimg::sqr(x - 192) + cimg::sqr(y - 77))) - 30)));
+    std::cout << "Signed distance of a disk of radius 30: maximal difference with the analytic distance " << diskError
+              << std::endl;
+
+    // Signed distance of the coins.
+    CImg<> coins("../images/coins.png");
+    coins.norm().blur(0.75).threshold(coins.median() + 30).blur_median(3.0f);
+    CImg<unsigned char> mask = coins;
+    CImg<> signedDistance = SignedDistance(mask, nbThreads);
+    signedDistance.get_cut(-40, 40).normalize(0, 255).save_png("./results/distance_transform_signed.png");
+
+    // Large images: comparison with CImg::distance(), and erosion by a disk.
+    CImg<unsigned char> large = mask.get_resize(4000, 3000);
+    auto t0 = std::chrono::steady_clock::now();
+    CImg<> distances = DistanceTransform(large, nbThreads);
+    auto t1 = std::chrono::steady_clock::now();
+    CImg<> cimgDistances = large.get_distance(1);
+    auto t2 = std::chrono::steady_clock::now();
+    std::cout << "4000x3000: " << std::chrono::duration<double>(t1 - t0).count() * 1000 << " ms (" << nbThreads
+              << " threads), CImg::distance(): " << std::chrono::duration<double>(t2 - t1).count() * 1000
+              << " ms, maximal difference " << (distances - cimgDistances).abs().max() << std::endl;
+
+    // CImg::erode() with a non-rectangular element is much slower, so the
+    // erosion is compared on a smaller image.
+    int r = 20;
+    CImg<unsigned char> medium = mask.get_resize(1000, 750);
+    CImg<unsigned char> background(medium.width(), medium.height()), element(2 * r + 1, 2 * r + 1);
+    cimg_foroff(medium, i) background[i] = !medium[i];
+    cimg_forXY(element, x, y) element(x, y) = cimg::sqr(x - r) + cimg::sqr(y - r) <= r * r;
+    t0 = std::chrono::steady_clock::now();
+    CImg<> toBackground = DistanceTransform(background, nbThreads);
+    CImg<unsigned char> eroded(medium.width(), medium.height());
+    cimg_foroff(eroded, i) eroded[i] = toBackground[i] > r;
+    t1 = std::chrono::steady_clock::now();
+    CImg<unsigned char> reference = medium.get_erode(element, 0);
+    t2 = std::chrono::steady_clock::now();
+    int different = 0;
+    cimg_foroff(eroded, i) different += eroded[i] != reference[i];
+    std::cout << "1000x750, erosion by a disk of radius " << r << ": " << std::chrono::duration<double>(t1 - t0).count() * 1000
+              << " ms, CImg::erode(): " << std::chrono::duration<double>(t2 - t1).count() * 1000 << " ms, "
+              << different << " different pixels" << std::endl;
+
+    // Fast marching: with a uniform speed, the arrival time from a single
+    // seed is the Euclidean distance, up to the error of the first-order
+    // scheme. With the speed f of the geodesic model (computed on the gray
+    // levels), the front slows down at the edges of the coins.
+    CImg<> uniform(256, 128, 1, 1, 1);
+    CImg<unsigned char> seed(256, 128, 1, 1, 0);
+    seed(192, 77) = 1;
+    CImg<> T = FastMarching(uniform, seed), exact = DistanceTransform(seed, nbThreads);
+    float relativeError = 0;
+    cimg_foroff(T, i) if (exact[i] >= 20)
+        relativeError = std::max(relativeError, std::abs(T[i] - exact[i]) / exact[i]);
+    std::cout << "Fast marching with a uniform speed: maximal relative error " << relativeError
+              << " (at a distance of 20 pixels or more)" << std::endl;
+
+    CImg<> gray("../images/coins.png");
+    gray.norm().blur(0.75).resize(256, 128);
+    CImgList<> gradImg = gray.get_gradient("xy", 4);
+    CImg<> f(gray.width(), gray.height());
+    cimg_forXY(f, x, y) f(x, y) = 1. / (1 + std::sqrt(cimg::sqr(gradImg(0, x, y)) + cimg::sqr(gradImg(1, x, y)))) + 0.01;
+    t0 = std::chrono::steady_clock::now();
+    T = FastMarching(f, seed);
+    t1 = std::chrono::steady_clock::now();
+    std::cout << "Fast marching with the speed of the geodesic model: "
+              << std::chrono::duration<double>(t1 - t0).count() * 1000 << " ms" << std::endl;
+    T.cut(0, 4000).normalize(0, 255).save_png("./results/distance_transform_fast_marching.png");
+
+    return 0;
+}
@@ -0,0 +1,978 @@
+/*
+    K-means with Hamerly's bounds
+
+    AssignToNearestClass in k_means.cpp computes the distance from every
+    pixel to every center at each iteration, then TotalWithinClusterVariance
+    goes over the image again. Here:
+    - The features are interleaved (one row of dim values per pixel), so that
+      the features of a pixel are contiguous.
+    - Each point keeps an upper bound u on the distance to its center, and a
+      lower bound l on the distance to any other center (Hamerly, 2010). When
+      the centers move by p_j, u grows by the motion of its center and l
+      shrinks by the largest motion. A point can not change of cluster if u
+      is below l, or below half the distance s_j from its center to the
+      closest other center, and then no distance is computed.
+    - The assignment and the sums of the next centers are fused in a single
+      pass, with partial sums per thread. The iterations stop when no point
+      changes of cluster, so the objective is only computed once at the end.
+    The result is exactly the one of Lloyd's iterations from the same
+    initial centers, which is also available for comparison.
+
+    The initial centers come from k-means++, or from its parallel variant
+    k-means|| for large images, with a fixed seed. For very large images,
+    mini-batch k-means updates the centers from random batches of pixels,
+    and only goes over the whole image once at the end.
+
+    To choose k, the features are computed once with integral images, and
+    k goes from 2 to kMax, each k starting from the centers of the previous
+    one with its largest cluster split in two. Each clustering is scored by
+    its inertia (elbow) and by its silhouette on a sample of the pixels.
+*/
+
+#define cimg_use_png
+#include "CImg.h"
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>
+
+using namespace cimg_library;
+
+// Parameters of the k-means engine.
+struct KMeansParams
+{
+    int maxIterations;
+    bool useBounds; // Hamerly's bounds, or plain Lloyd's iterations
+    unsigned int nbThreads;
+};
+
+// Result of the k-means engine.
+struct KMeansResult
+{
+    CImg<unsigned int> labels; // Cluster of each point (n)
+    CImg<> centers;            // Centers (dim, k)
+    int iterations;
+    uint64_t distances;        // Number of point-center distances computed
+    double inertia;            // Sum of the squared distances to the centers
+};
+
+/*
+  Squared Euclidean distance between two vectors.
+*/
+inline float Distance2(const float *a, const float *b, int dim)
+{
+    float d = 0;
+    for (int i = 0; i < dim; ++i)
+        d += (a[i] - b[i]) * (a[i] - b[i]);
+    return d;
+}
+
+/*
+  Sum of the squared distances from the points to their centers.
+  features  : Feature vectors (dim, n)
+  centers   : Centers (dim, k)
+  labels    : Cluster of each point (n)
+  nbThreads : Number of threads
+*/
+double Inertia(const CImg<> &features, const CImg<> &centers, const CImg<unsigned int> &labels, unsigned int nbThreads)
+{
+    nbThreads = std::max(1u, nbThreads);
+    int
+        dim = features.width(),
+        n = features.height();
+    std::vector<double> partial(nbThreads, 0);
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back([&, dim, t](int first, int last)
+                             {
+                                 double sum = 0;
+                                 for (int i = first; i < last; ++i)
+                                     sum += Distance2(features.data(0, i), centers.data(0, labels[i]), dim);
+                                 partial[t] = sum; },
+                             (int)((long long)n * t / nbThreads), (int)((long long)n * (t + 1) / nbThreads));
+    for (auto &wk : workers)
+        wk.join();
+    double inertia = 0;
+    for (double p : partial)
+        inertia += p;
+    return inertia;
+}
+
+/*
+  K-means from given initial centers.
+  features : Feature vectors (dim, n)
+  centers  : Initial centers (dim, k)
+  params   : Parameters
+*/
+KMeansResult KMeans(const CImg<> &features, const CImg<> &initialCenters, const KMeansParams &params)
+{
+    unsigned int nbThreads = std::max(1u, params.nbThreads);
+    int
+        dim = features.width(),
+        n = features.height(),
+        k = initialCenters.height();
+    KMeansResult result;
+    result.centers = initialCenters;
+    result.labels.assign(n).fill(0);
+    result.iterations = 0;
+    result.distances = 0;
+    CImg<> &centers = result.centers;
+    CImg<unsigned int> &labels = result.labels;
+
+    std::vector<float>
+        upper(n, 0), lower(n, 0),
+        s(k, 0), motion(k, 0);
+    int fastest = 0;
+    float maxMotion = 0, secondMotion = 0;
+
+    // Per-thread sums of the points of each cluster, and counters.
+    struct Partial
+    {
+        std::vector<double> sums;
+        std::vector<uint64_t> counts;
+        uint64_t distances, changes;
+    };
+    std::vector<Partial> partial(nbThreads);
+
+    // Fused update of the bounds, assignment and accumulation. In the first
+    // pass, or without the bounds, every distance is computed.
+    auto pass = [&, dim, k](int first, int last, Partial &part, bool full)
+    {
+        std::fill(part.sums.begin(), part.sums.end(), 0.0);
+        std::fill(part.counts.begin(), part.counts.end(), 0);
+        part.distances = part.changes = 0;
+        for (int i = first; i < last; ++i)
+        {
+            const float *x = features.data(0, i);
+            unsigned int a = labels[i];
+            bool search = full;
+            if (!full)
+            {
+                upper[i] += motion[a];
+                lower[i] -= (int)a == fastest ? secondMotion : maxMotion;
+                float bound = std::max(s[a], lower[i]);
+                if (upper[i] > bound)
+                {
+                    // Tighten the upper bound, then test again.
+                    upper[i] = std::sqrt(Distance2(x, centers.data(0, a), dim));
+                    ++part.distances;
+                    search = upper[i] > bound;
+                }
+            }
+            if (search)
+            {
+                float d1 = std::numeric_limits<float>::max(), d2 = d1;
+                unsigned int best = 0;
+                for (int j = 0; j < k; ++j)
+                {
+                    float d = Distance2(x, centers.data(0, j), dim);
+                    if (d < d1)
+                    {
+                        d2 = d1;
+                        d1 = d;
+                        best = j;
+                    }
+                    else if (d < d2)
+                        d2 = d;
+                }
+                part.distances += k;
+                part.changes += best != a;
+                labels[i] = a = best;
+                upper[i] = std::sqrt(d1);
+                lower[i] = std::sqrt(d2);
+            }
+            double *sum = part.sums.data() + (size_t)a * dim;
+            for (int d = 0; d < dim; ++d)
+                sum[d] += x[d];
+            ++part.counts[a];
+        }
+    };
+
+    for (auto &part : partial)
+    {
+        part.sums.assign((size_t)k * dim, 0);
+        part.counts.assign(k, 0);
+    }
+    bool full = true;
+    while (result.iterations < params.maxIterations)
+    {
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < nbThreads; ++t)
+            workers.emplace_back(pass, (int)((long long)n * t / nbThreads), (int)((long long)n * (t + 1) / nbThreads),
+                                 std::ref(partial[t]), full);
+        for (auto &wk : workers)
+            wk.join();
+        ++result.iterations;
+
+        uint64_t changes = 0;
+        for (auto &part : partial)
+        {
+            result.distances += part.distances;
+            changes += part.changes;
+        }
+        if (result.iterations > 1 && changes == 0)
+            break;
+
+        // New centers (an empty cluster keeps its center), and their motion.
+        for (int j = 0; j < k; ++j)
+        {
+            uint64_t count = 0;
+            for (auto &part : partial)
+                count += part.counts[j];
+            float move = 0;
+            for (int d = 0; d < dim && count > 0; ++d)
+            {
+                double sum = 0;
+                for (auto &part : partial)
+                    sum += part.sums[(size_t)j * dim + d];
+                float c = (float)(sum / count);
+                move += (c - centers(d, j)) * (c - centers(d, j));
+                centers(d, j) = c;
+            }
+            motion[j] = std::sqrt(move);
+        }
+        full = !params.useBounds;
+        if (full)
+            continue;
+
+        // Largest motions for the bounds, and half distance to the closest
+        // other center.
+        fastest = (int)(std::max_element(motion.begin(), motion.end()) - motion.begin());
+        maxMotion = motion[fastest];
+        secondMotion = 0;
+        for (int j = 0; j < k; ++j)
+            if (j != fastest)
+                secondMotion = std::max(secondMotion, motion[j]);
+        for (int j = 0; j < k; ++j)
+        {
+            float dmin = std::numeric_limits<float>::max();
+            for (int jj = 0; jj < k; ++jj)
+                if (jj != j)
+                    dmin = std::min(dmin, Distance2(centers.data(0, j), centers.data(0, jj), dim));
+            s[j] = std::sqrt(dmin) / 2;
+        }
+    }
+    result.inertia = Inertia(features, centers, labels, nbThreads);
+    return result;
+}
+
+/*
+  Runs f(first, last, t) on nbThreads ranges t splitting [0, n).
+*/
+template <typename F>
+void ParallelFor(int n, unsigned int nbThreads, F f)
+{
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(f, (int)((long long)n * t / nbThreads), (int)((long long)n * (t + 1) / nbThreads), t);
+    for (auto &wk : workers)
+        wk.join();
+}
+
+/*
+  Nearest center of each point, and sum of the squared distances.
+  features  : Feature vectors (dim, n)
+  centers   : Centers (dim, k)
+  labels    : Output, cluster of each point (n)
+  nbThreads : Number of threads
+*/
+double AssignNearest(const CImg<> &features, const CImg<> &centers, CImg<unsigned int> &labels, unsigned int nbThreads)
+{
+    nbThreads = std::max(1u, nbThreads);
+    int
+        dim = features.width(),
+        n = features.height(),
+        k = centers.height();
+    labels.assign(n);
+    std::vector<double> partial(nbThreads, 0);
+    ParallelFor(n, nbThreads, [&, dim, k](int first, int last, unsigned int t)
+                {
+                    double sum = 0;
+                    for (int i = first; i < last; ++i)
+                    {
+                        float dmin = std::numeric_limits<float>::max();
+                        for (int j = 0; j < k; ++j)
+                        {
+                            float d = Distance2(features.data(0, i), centers.data(0, j), dim);
+                            if (d < dmin)
+                            {
+                                dmin = d;
+                                labels[i] = j;
+                            }
+                        }
+                        sum += dmin;
+                    }
+                    partial[t] = sum; });
+    double inertia = 0;
+    for (double p : partial)
+        inertia += p;
+    return inertia;
+}
+
+/*
+  Weighted k-means++ seeding: each new center is a point drawn with a
+  probability proportional to its weight times its squared distance to the
+  closest center already chosen.
+  features  : Feature vectors (dim, n)
+  weights   : Weight of each point (all 1 if empty)
+  k         : Number of centers
+  rng       : Random generator
+  nbThreads : Number of threads
+*/
+CImg<> KMeansPlusPlus(const CImg<> &features, const std::vector<double> &weights, int k, std::mt19937 &rng,
+                      unsigned int nbThreads)
+{
+    nbThreads = std::max(1u, nbThreads);
+    int
+        dim = features.width(),
+        n = features.height();
+    CImg<> centers(dim, k);
+    std::vector<double> d2(n, 1.0), partial(nbThreads, 0);
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    // Draws a point with a probability proportional to d2 * weight, from
+    // the totals of the ranges of points computed in parallel.
+    auto draw = [&]()
+    {
+        double total = 0;
+        for (double p : partial)
+            total += p;
+        double r = uniform(rng) * total;
+        unsigned int t = 0;
+        while (t + 1 < nbThreads && r >= partial[t])
+            r -= partial[t++];
+        int
+            first = (int)((long long)n * t / nbThreads),
+            last = (int)((long long)n * (t + 1) / nbThreads);
+        for (int i = first; i < last; ++i)
+        {
+            r -= d2[i] * (weights.empty() ? 1 : weights[i]);
+            if (r < 0)
+                return i;
+        }
+        return last - 1;
+    };
+
+    // The first center is drawn with the weights only (d2 = 1).
+    ParallelFor(n, nbThreads, [&](int first, int last, unsigned int t)
+                {
+                    double sum = 0;
+                    for (int i = first; i < last; ++i)
+                        sum += weights.empty() ? 1 : weights[i];
+                    partial[t] = sum; });
+    for (int c = 0; c < k; ++c)
+    {
+        int chosen = draw();
+        cimg_forX(centers, d) centers(d, c) = features(d, chosen);
+        if (c == k - 1)
+            break;
+        ParallelFor(n, nbThreads, [&, dim, c](int first, int last, unsigned int t)
+                    {
+                        double sum = 0;
+                        for (int i = first; i < last; ++i)
+                        {
+                            double d = Distance2(features.data(0, i), centers.data(0, c), dim);
+                            d2[i] = c == 0 ? d : std::min(d2[i], d);
+                            sum += d2[i] * (weights.empty() ? 1 : weights[i]);
+                        }
+                        partial[t] = sum; });
+    }
+    return centers;
+}
+
+/*
+  k-means|| seeding (Bahmani et al., 2012): a few passes draw about 2k
+  candidates each, independently for every point, then the candidates,
+  weighted by the number of points closest to them, are reduced to k
+  centers with k-means++ and a few weighted Lloyd iterations. Points are
+  drawn in fixed blocks with their own generator, so that the result does
+  not depend on the number of threads.
+  features     : Feature vectors (dim, n)
+  k            : Number of centers
+  rounds       : Number of sampling passes
+  seed         : Random seed
+  nbThreads    : Number of threads
+  nbCandidates : Output, number of candidates (if not null)
+*/
+CImg<> KMeansParallel(const CImg<> &features, int k, int rounds, unsigned int seed, unsigned int nbThreads,
+                      int *nbCandidates = 0)
+{
+    nbThreads = std::max(1u, nbThreads);
+    const int BLOCK = 4096;
+    int
+        dim = features.width(),
+        n = features.height(),
+        nbBlocks = (n + BLOCK - 1) / BLOCK;
+    double oversampling = 2.0 * k;
+    std::mt19937 rng(seed);
+
+    std::vector<int> candidates = {std::uniform_int_distribution<int>(0, n - 1)(rng)};
+    std::vector<double> d2(n, std::numeric_limits<double>::max()), partial(nbThreads, 0);
+    std::vector<int> nearest(n, 0);
+    std::vector<std::vector<int>> drawn(nbThreads);
+
+    // Distances to the candidates from index first on, and their total.
+    auto update = [&](size_t firstCandidate)
+    {
+        ParallelFor(n, nbThreads, [&, dim, firstCandidate](int first, int last, unsigned int t)
+                    {
+                        double sum = 0;
+                        for (int i = first; i < last; ++i)
+                        {
+                            for (size_t c = firstCandidate; c < candidates.size(); ++c)
+                            {
+                                double d = Distance2(features.data(0, i), features.data(0, candidates[c]), dim);
+                                if (d < d2[i])
+                                {
+                                    d2[i] = d;
+                                    nearest[i] = (int)c;
+                                }
+                            }
+                            sum += d2[i];
+                        }
+                        partial[t] = sum; });
+        double phi = 0;
+        for (double p : partial)
+            phi += p;
+        return phi;
+    };
+
+    double phi = update(0);
+    for (int r = 0; r < rounds && phi > 0; ++r)
+    {
+        ParallelFor(nbBlocks, nbThreads, [&, n, r, phi](int b0, int b1, unsigned int t)
+                    {
+                        drawn[t].clear();
+                        std::uniform_real_distribution<double> uniform(0, 1);
+                        for (int b = b0; b < b1; ++b)
+                        {
+                            std::mt19937 blockRng(seed + 7919u * (r + 1) + 104729u * b);
+                            for (int i = b * BLOCK; i < std::min(n, (b + 1) * BLOCK); ++i)
+                                if (uniform(blockRng) < oversampling * d2[i] / phi)
+                                    drawn[t].push_back(i);
+                        } });
+        size_t previous = candidates.size();
+        for (auto &list : drawn)
+            candidates.insert(candidates.end(), list.begin(), list.end());
+        phi = update(previous);
+    }
+
+    // Weighted reduction of the candidates to k centers.
+    int m = (int)candidates.size();
+    if (nbCandidates)
+        *nbCandidates = m;
+    CImg<> points(dim, m);
+    std::vector<double> weights(m, 0);
+    for (int c = 0; c < m; ++c)
+        cimg_forX(points, d) points(d, c) = features(d, candidates[c]);
+    for (int i = 0; i < n; ++i)
+        weights[nearest[i]] += 1;
+    if (m <= k)
+    {
+        CImg<> centers(dim, k);
+        for (int j = 0; j < k; ++j)
+            cimg_forX(centers, d) centers(d, j) = points(d, j % m);
+        return centers;
+    }
+    CImg<> centers = KMeansPlusPlus(points, weights, k, rng, 1);
+    CImg<unsigned int> labels;
+    for (int it = 0; it < 20; ++it)
+    {
+        AssignNearest(points, centers, labels, 1);
+        CImg<double> sums(dim + 1, k, 1, 1, 0);
+        for (int c = 0; c < m; ++c)
+        {
+            for (int d = 0; d < dim; ++d)
+                sums(d, labels[c]) += weights[c] * points(d, c);
+            sums(dim, labels[c]) += weights[c];
+        }
+        cimg_forY(centers, j) if (sums(dim, j) > 0)
+            cimg_forX(centers, d) centers(d, j) = (float)(sums(d, j) / sums(dim, j));
+    }
+    return centers;
+}
+
+/*
+  Mini-batch k-means (Sculley, 2010): each batch of random points is
+  assigned to the current centers, and each point then moves its center
+  with a rate 1 / (number of points the center has received). The labels
+  and the inertia come from one final pass over all the points.
+  features       : Feature vectors (dim, n)
+  initialCenters : Initial centers (dim, k)
+  batchSize      : Number of points per batch
+  nbBatches      : Number of batches
+  seed           : Random seed
+  nbThreads      : Number of threads
+*/
+KMeansResult MiniBatchKMeans(const CImg<> &features, const CImg<> &initialCenters, int batchSize, int nbBatches,
+                             unsigned int seed, unsigned int nbThreads)
+{
+    nbThreads = std::max(1u, nbThreads);
+    int
+        dim = features.width(),
+        n = features.height(),
+        k = initialCenters.height();
+    KMeansResult result;
+    result.centers = initialCenters;
+    CImg<> &centers = result.centers;
+    std::vector<double> received(k, 0);
+    std::vector<int> batch(batchSize), nearest(batchSize);
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> pick(0, n - 1);
+
+    for (int b = 0; b < nbBatches; ++b)
+    {
+        for (int &i : batch)
+            i = pick(rng);
+        ParallelFor(batchSize, nbThreads, [&, dim, k](int first, int last, unsigned int)
+                    {
+                        for (int s = first; s < last; ++s)
+                        {
+                            float dmin = std::numeric_limits<float>::max();
+                            for (int j = 0; j < k; ++j)
+                            {
+                                float d = Distance2(features.data(0, batch[s]), centers.data(0, j), dim);
+                                if (d < dmin)
+                                {
+                                    dmin = d;
+                                    nearest[s] = j;
+                                }
+                            }
+                        } });
+        for (int s = 0; s < batchSize; ++s)
+        {
+            int j = nearest[s];
+            float eta = (float)(1 / ++received[j]);
+            for (int d = 0; d < dim; ++d)
+                centers(d, j) += eta * (features(d, batch[s]) - centers(d, j));
+        }
+    }
+    result.inertia = AssignNearest(features, centers, result.labels, nbThreads);
+    result.iterations = nbBatches;
+    result.distances = ((uint64_t)nbBatches * batchSize + n) * k;
+    return result;
+}
+
+/*
+  Features of k_means.cpp (mean and variance in a 5x5 neighborhood, each
+  normalized to [0, 255]) from integral images of I and I^2, in O(1) per
+  pixel. The image is padded by replication, as with cimg_for5x5.
+  imgIn     : Input image (x, y, 1, 1, 1, 1)
+  nbThreads : Number of threads
+*/
+CImg<> ComputeFeaturesIntegral(const CImg<> &imgIn, unsigned int nbThreads)
+{
+    nbThreads = std::max(1u, nbThreads);
+    int
+        w = imgIn.width(),
+        h = imgIn.height();
+    CImg<double> S(w + 5, h + 5, 1, 1, 0), S2(w + 5, h + 5, 1, 1, 0);
+    ParallelFor(h + 4, nbThreads, [&, w, h](int first, int last, unsigned int)
+                {
+                    for (int y = first; y < last; ++y)
+                    {
+                        const float *in = imgIn.data(0, std::min(std::max(y - 2, 0), h - 1));
+                        double *s = S.data(0, y + 1), *s2 = S2.data(0, y + 1), sum = 0, sum2 = 0;
+                        for (int x = 0; x < w + 4; ++x)
+                        {
+                            double v = in[std::min(std::max(x - 2, 0), w - 1)];
+                            sum += v;
+                            sum2 += v * v;
+                            s[x + 1] = sum;
+                            s2[x + 1] = sum2;
+                        }
+                    } });
+    ParallelFor(w + 5, nbThreads, [&, h](int first, int last, unsigned int)
+                {
+                    for (int y = 1; y < h + 5; ++y)
+                        for (int x = first; x < last; ++x)
+                        {
+                            S(x, y) += S(x, y - 1);
+                            S2(x, y) += S2(x, y - 1);
+                        } });
+
+    // Mean and unbiased variance (as CImg::variance()) of each 5x5 window.
+    CImg<> features(2, w * h);
+    ParallelFor(h, nbThreads, [&, w](int first, int last, unsigned int)
+                {
+                    for (int y = first; y < last; ++y)
+                        for (int x = 0; x < w; ++x)
+                        {
+                            double
+                                s = S(x + 5, y + 5) - S(x, y + 5) - S(x + 5, y) + S(x, y),
+                                s2 = S2(x + 5, y + 5) - S2(x, y + 5) - S2(x + 5, y) + S2(x, y);
+                            features(0, x + y * w) = (float)(s / 25);
+                            features(1, x + y * w) = (float)std::max((s2 - s * s / 25) / 24, 0.0);
+                        } });
+
+    // Normalization
+    for (int d = 0; d < 2; ++d)
+    {
+        float vmin = features(d, 0), vmax = vmin;
+        cimg_forY(features, i)
+        {
+            vmin = std::min(vmin, features(d, i));
+            vmax = std::max(vmax, features(d, i));
+        }
+        float scale = vmax > vmin ? 255 / (vmax - vmin) : 0;
+        cimg_forY(features, i) features(d, i) = (features(d, i) - vmin) * scale;
+    }
+    return features;
+}
+
+/*
+  Warm start for k + 1 clusters: the cluster with the largest sum of
+  squared distances is split in two, one standard deviation away from its
+  center on each side, along its feature of largest variance.
+  features  : Feature vectors (dim, n)
+  centers   : Centers of the k clusters (dim, k)
+  labels    : Cluster of each point (n)
+  nbThreads : Number of threads
+*/
+CImg<> SplitLargestCluster(const CImg<> &features, const CImg<> &centers, const CImg<unsigned int> &labels,
+                           unsigned int nbThreads)
+{
+    nbThreads = std::max(1u, nbThreads);
+    int
+        dim = features.width(),
+        n = features.height(),
+        k = centers.height();
+
+    // Sums of squared deviations per cluster and feature, and counts.
+    std::vector<CImg<double>> partial(nbThreads, CImg<double>(dim + 1, k, 1, 1, 0));
+    ParallelFor(n, nbThreads, [&, dim](int first, int last, unsigned int t)
+                {
+                    CImg<double> &stats = partial[t];
+                    for (int i = first; i < last; ++i)
+                    {
+                        unsigned int j = labels[i];
+                        for (int d = 0; d < dim; ++d)
+                            stats(d, j) += cimg::sqr(features(d, i) - centers(d, j));
+                        stats(dim, j) += 1;
+                    } });
+    CImg<double> stats(dim + 1, k, 1, 1, 0);
+    for (auto &p : partial)
+        stats += p;
+
+    int largest = 0;
+    double largestSSE = -1;
+    for (int j = 0; j < k; ++j)
+    {
+        double sse = 0;
+        for (int d = 0; d < dim; ++d)
+            sse += stats(d, j);
+        if (sse > largestSSE)
+        {
+            largestSSE = sse;
+            largest = j;
+        }
+    }
+    int axis = 0;
+    for (int d = 1; d < dim; ++d)
+        if (stats(d, largest) > stats(axis, largest))
+            axis = d;
+    float sigma = (float)std::sqrt(stats(axis, largest) / std::max(stats(dim, largest), 1.0));
+
+    CImg<> split(dim, k + 1);
+    cimg_forXY(centers, d, j) split(d, j) = centers(d, j);
+    cimg_forX(split, d) split(d, k) = centers(d, largest);
+    split(axis, largest) -= sigma;
+    split(axis, k) += sigma;
+    return split;
+}
+
+/*
+  Mean silhouette of a clustering, estimated on a sample of the points:
+  s = (b - a) / max(a, b), where a is the mean distance to the sampled
+  points of the same cluster, and b the smallest mean distance to the
+  sampled points of another cluster. The sampled points are processed in
+  parallel.
+  features  : Feature vectors (dim, n)
+  labels    : Cluster of each point (n)
+  k         : Number of clusters
+  sample    : Indices of the sampled points
+  nbThreads : Number of threads
+*/
+double Silhouette(const CImg<> &features, const CImg<unsigned int> &labels, int k, const std::vector<int> &sample,
+                  unsigned int nbThreads)
+{
+    nbThreads = std::max(1u, nbThreads);
+    int
+        dim = features.width(),
+        m = (int)sample.size();
+    std::vector<int> counts(k, 0);
+    for (int i : sample)
+        ++counts[labels[i]];
+
+    std::vector<double> partial(nbThreads, 0);
+    ParallelFor(m, nbThreads, [&, dim, k, m](int first, int last, unsigned int t)
+                {
+                    std::vector<double> sums(k);
+                    double total = 0;
+                    for (int s = first; s < last; ++s)
+                    {
+                        const float *x = features.data(0, sample[s]);
+                        unsigned int own = labels[sample[s]];
+                        if (counts[own] < 2)
+                            continue;
+                        std::fill(sums.begin(), sums.end(), 0.0);
+                        for (int o = 0; o < m; ++o)
+                            sums[labels[sample[o]]] += std::sqrt(Distance2(x, features.data(0, sample[o]), dim));
+                        double
+                            a = sums[own] / (counts[own] - 1),
+                            b = std::numeric_limits<double>::max();
+                        for (int j = 0; j < k; ++j)
+                            if (j != (int)own && counts[j] > 0)
+                                b = std::min(b, sums[j] / counts[j]);
+                        if (b < std::numeric_limits<double>::max() && std::max(a, b) > 0)
+                            total += (b - a) / std::max(a, b);
+                    }
+                    partial[t] = total; });
+    double total = 0;
+    for (double p : partial)
+        total += p;
+    return total / m;
+}
+
+// Clustering for one value of k in a sweep.
+struct SweepResult
+{
+    int k;
+    KMeansResult clustering;
+    double silhouette;
+    double seconds; // K-means and silhouette
+};
+
+/*
+  K-means for k = 2 to kMax on the same features. k = 2 starts from
+  k-means++, and each next k from the previous centers, with the largest
+  cluster split in two.
+  features   : Feature vectors (dim, n)
+  kMax       : Largest number of clusters
+  sampleSize : Number of points for the silhouette
+  seed       : Random seed
+  nbThreads  : Number of threads
+*/
+std::vector<SweepResult> KMeansSweep(const CImg<> &features, int kMax, int sampleSize, unsigned int seed,
+                                     unsigned int nbThreads)
+{
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> pick(0, features.height() - 1);
+    std::vector<int> sample(sampleSize);
+    for (int &i : sample)
+        i = pick(rng);
+
+    std::vector<SweepResult> results;
+    CImg<> centers = KMeansPlusPlus(features, std::vector<double>(), 2, rng, nbThreads);
+    for (int k = 2; k <= kMax; ++k)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        if (k > 2)
+        {
+            const KMeansResult &previous = results.back().clustering;
+            centers = SplitLargestCluster(features, previous.centers, previous.labels, nbThreads);
+        }
+        SweepResult r;
+        r.k = k;
+        r.clustering = KMeans(features, centers, {1000, true, nbThreads});
+        r.silhouette = Silhouette(features, r.clustering.labels, k, sample, nbThreads);
+        r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        results.push_back(r);
+    }
+    return results;
+}
+
+/*
+  Elbow of the inertia curve: the k where the decrease of the inertia slows
+  down the most (largest second difference).
+*/
+int ElbowK(const std::vector<SweepResult> &results)
+{
+    int best = results.front().k;
+    double bestCurvature = -std::numeric_limits<double>::max();
+    for (size_t i = 1; i + 1 < results.size(); ++i)
+    {
+        double curvature = results[i - 1].clustering.inertia - 2 * results[i].clustering.inertia +
+                           results[i + 1].clustering.inertia;
+        if (curvature > bestCurvature)
+        {
+            bestCurvature = curvature;
+            best = results[i].k;
+        }
+    }
+    return best;
+}
+
+/*
+  Features computation, copied from k_means.cpp.
+  imgIn : Input image (x, y, 1, 1, 1, 1)
+*/
+CImg<> ComputeFeatures(CImg<> &imgIn)
+{
+    CImg<> features(imgIn.width(), imgIn.height(), 2);
+    // For each pixel, mean and variance in a 5x5 neighborhood.
+    CImg<> N(5, 5);
+    cimg_for5x5(imgIn, x, y, 0, 0, N, float)
+    {
+        features(x, y, 0) = N.mean();
+        features(x, y, 1) = N.variance();
+    }
+    // Normalization
+    features.get_shared_slice(0).normalize(0, 255);
+    features.get_shared_slice(1).normalize(0, 255);
+    return features;
+}
+
+/*
+  Interleaved copy of planar features: (x, y, dim) to (dim, x + y * width).
+*/
+CImg<> Interleave(const CImg<> &planar)
+{
+    int dim = planar.depth();
+    CImg<> features(dim, planar.width() * planar.height());
+    cimg_forXYZ(planar, x, y, d)
+        features(d, x + y * planar.width()) = planar(x, y, d);
+    return features;
+}
+
+/*
+  Initial centers drawn among the points, with a fixed seed.
+*/
+CImg<> RandomCenters(const CImg<> &features, int k, unsigned int seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> pick(0, features.height() - 1);
+    CImg<> centers(features.width(), k);
+    cimg_forY(centers, j)
+    {
+        int i = pick(rng);
+        cimg_forX(centers, d) centers(d, j) = features(d, i);
+    }
+    return centers;
+}
+
+int main()
+{
+    unsigned int nbThreads = std::max(1u, std::thread::hardware_concurrency());
+    CImg<> img("../images/lighthouse.png");
+    img.norm().blur(0.75f).normalize(0, 255);
+    CImg<> planar = ComputeFeatures(img), features = Interleave(planar);
+
+    for (int k = 2; k <= 8; ++k)
+    {
+        CImg<> centers = RandomCenters(features, k, 42);
+        auto t0 = std::chrono::steady_clock::now();
+        KMeansResult lloyd = KMeans(features, centers, {1000, false, nbThreads});
+        auto t1 = std::chrono::steady_clock::now();
+        KMeansResult hamerly = KMeans(features, centers, {1000, true, nbThreads});
+        auto t2 = std::chrono::steady_clock::now();
+        int differences = 0;
+        cimg_foroff(lloyd.labels, i) differences += lloyd.labels[i] != hamerly.labels[i];
+        std::cout << "k = " << k << ": " << hamerly.iterations << " iterations, inertia " << hamerly.inertia
+                  << ", " << differences << " different labels" << std::endl
+                  << "    Lloyd: " << lloyd.distances << " distances, "
+                  << std::chrono::duration<double>(t1 - t0).count() * 1000 << " ms" << std::endl
+                  << "    Hamerly: " << hamerly.distances << " distances ("
+                  << (double)lloyd.distances / hamerly.distances << "x fewer), "
+                  << std::chrono::duration<double>(t2 - t1).count() * 1000 << " ms" << std::endl;
+        if (k == 8)
+        {
+            CImg<unsigned int> labels(hamerly.labels.data(), img.width(), img.height());
+            img.get_append(CImg<>(labels).normalize(0, 255)).save_png("./results/kmeans_fast_8.png");
+        }
+    }
+
+    // Model selection on the same features, computed with integral images.
+    auto tf0 = std::chrono::steady_clock::now();
+    CImg<> integralFeatures = ComputeFeaturesIntegral(img, nbThreads);
+    auto tf1 = std::chrono::steady_clock::now();
+    CImg<> reference = ComputeFeatures(img);
+    auto tf2 = std::chrono::steady_clock::now();
+    std::cout << "Features: " << std::chrono::duration<double>(tf1 - tf0).count() * 1000 << " ms, k_means.cpp: "
+              << std::chrono::duration<double>(tf2 - tf1).count() * 1000 << " ms, maximal difference "
+              << (integralFeatures - Interleave(reference)).abs().max() << std::endl;
+
+    std::vector<SweepResult> sweep = KMeansSweep(integralFeatures, 8, 2000, 42, nbThreads);
+    double bestSilhouette = -1;
+    int bestK = 2;
+    for (const SweepResult &r : sweep)
+    {
+        std::mt19937 rng(42);
+        auto t0 = std::chrono::steady_clock::now();
+        KMeansResult cold = KMeans(integralFeatures, KMeansPlusPlus(integralFeatures, std::vector<double>(), r.k, rng, nbThreads),
+                                   {1000, true, nbThreads});
+        auto t1 = std::chrono::steady_clock::now();
+        std::cout << "k = " << r.k << ": inertia " << r.clustering.inertia << ", silhouette " << r.silhouette
+                  << ", " << r.clustering.iterations << " iterations, " << r.seconds * 1000 << " ms"
+                  << " (from k-means++: inertia " << cold.inertia << ", " << cold.iterations << " iterations, "
+                  << std::chrono::duration<double>(t1 - t0).count() * 1000 << " ms)" << std::endl;
+        if (r.silhouette > bestSilhouette)
+        {
+            bestSilhouette = r.silhouette;
+            bestK = r.k;
+        }
+    }
+    std::cout << "Best k: " << bestK << " (silhouette), " << ElbowK(sweep) << " (elbow)" << std::endl;
+
+    // Large image (16 times the lighthouse): seeding and mini-batch k-means
+    // against full iterations, with k = 8. The cost is given in distances per
+    // pixel: each seeding pass of k-means|| computes the distances to all the
+    // new candidates, while k-means++ adds one center per pass.
+    CImg<> large = img.get_resize(img.width() * 4, img.height() * 4, 1, 1, 3);
+    CImg<> largePlanar = ComputeFeatures(large);
+    features = Interleave(largePlanar);
+    const int k = 8, rounds = 5, batchSize = 4096, nbBatches = 200;
+    double n = features.height();
+    std::cout << "Large image: " << features.height() << " pixels, k = " << k << std::endl;
+    auto report = [](const std::string &name, double inertia, double distances, double passes, double seconds)
+    {
+        std::cout << "    " << name << ": inertia " << inertia << ", " << distances << " distances per pixel, "
+                  << passes << " passes, " << seconds * 1000 << " ms" << std::endl;
+    };
+    auto seconds = [](std::chrono::steady_clock::time_point t0, std::chrono::steady_clock::time_point t1)
+    { return std::chrono::duration<double>(t1 - t0).count(); };
+
+    auto t0 = std::chrono::steady_clock::now();
+    KMeansResult random = KMeans(features, RandomCenters(features, k, 42), {1000, true, nbThreads});
+    auto t1 = std::chrono::steady_clock::now();
+    report("random + Hamerly", random.inertia, random.distances / n + 1, random.iterations + 1, seconds(t0, t1));
+
+    t0 = std::chrono::steady_clock::now();
+    std::mt19937 rng(42);
+    CImg<> plusPlusSeeds = KMeansPlusPlus(features, std::vector<double>(), k, rng, nbThreads);
+    auto tSeeds = std::chrono::steady_clock::now();
+    KMeansResult plusPlus = KMeans(features, plusPlusSeeds, {1000, true, nbThreads});
+    t1 = std::chrono::steady_clock::now();
+    KMeansResult miniBatch = MiniBatchKMeans(features, plusPlusSeeds, batchSize, nbBatches, 42, nbThreads);
+    auto t2 = std::chrono::steady_clock::now();
+    report("k-means++ + Hamerly", plusPlus.inertia, k - 1 + plusPlus.distances / n + 1,
+           k - 1 + plusPlus.iterations + 1, seconds(t0, t1));
+    report("k-means++ + mini-batch", miniBatch.inertia, k - 1 + miniBatch.distances / n,
+           k - 1 + nbBatches * batchSize / n + 1, seconds(t0, tSeeds) + seconds(t1, t2));
+    std::cout << "        (k-means++ seeding: " << seconds(t0, tSeeds) * 1000 << " ms, mini-batch: "
+              << seconds(t1, t2) * 1000 << " ms)" << std::endl;
+
+    int nbCandidates = 0;
+    t0 = std::chrono::steady_clock::now();
+    CImg<> seeds = KMeansParallel(features, k, rounds, 42, nbThreads, &nbCandidates);
+    tSeeds = std::chrono::steady_clock::now();
+    KMeansResult parallel = KMeans(features, seeds, {1000, true, nbThreads});
+    t1 = std::chrono::steady_clock::now();
+    report("k-means|| + Hamerly", parallel.inertia, nbCandidates + parallel.distances / n + 1,
+           rounds + 1 + parallel.iterations + 1, seconds(t0, t1));
+    std::cout << "        (k-means|| seeding: " << nbCandidates << " candidates, " << seconds(t0, tSeeds) * 1000
+              << " ms)" << std::endl;
+
+    // The seeding does not depend on the number of threads.
+    CImg<> seeds3 = KMeansParallel(features, k, rounds, 42, 3);
+    std::cout << "k-means|| with 3 threads: maximal difference " << (seeds - seeds3).abs().max() << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,341 @@
+/*
+    Local thresholding with large windows (Bernsen, Niblack, Sauvola)
+
+    bernsen.cpp scans a 5x5 neighborhood for each pixel, so its cost grows
+    with the square of the window size. Document binarization needs windows
+    of 31 to 101 pixels, so here every statistic costs O(1) per pixel:
+    - Bernsen: the min and max over a (2r+1) x (2r+1) window are separable,
+      and each 1D pass uses the algorithm of van Herk (1992) and Gil and
+      Werman (1993): the signal is cut into blocks of 2r+1 samples, and the
+      window extremum is the min/max of a suffix of one block and a prefix of
+      the next one, i.e. 3 comparisons per sample whatever the window size.
+    - Niblack and Sauvola: the local mean and standard deviation come from
+      integral images of I and I^2, in double precision.
+    The vertical pass of Bernsen and the thresholds are computed row by row,
+    so that the loops run along contiguous memory, and rows are split into
+    bands processed in parallel.
+*/
+
+#define cimg_use_png
+#include "CImg.h"
+
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+using namespace cimg_library;
+
+/*
+  Runs f(first, last) on nbThreads ranges splitting [0, n).
+*/
+template <typename F>
+void ParallelFor(int n, unsigned int nbThreads, F f)
+{
+    nbThreads = std::max(1u, std::min(nbThreads, (unsigned int)std::max(n, 1)));
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(f, (int)((long long)n * t / nbThreads), (int)((long long)n * (t + 1) / nbThreads));
+    for (auto &wk : workers)
+        wk.join();
+}
+
+/*
+  Running min and max of a row over windows of 2r + 1 samples, with
+  replicated borders (van Herk / Gil-Werman).
+  in             : Input row
+  w              : Length of the row
+  r              : Half size of the window
+  outMin, outMax : Output rows
+  pad, g, h      : Work buffers
+*/
+void RunningMinMaxRow(const float *in, int w, int r, float *outMin, float *outMax,
+                      std::vector<float> &pad, std::vector<float> &g, std::vector<float> &h)
+{
+    int
+        k = 2 * r + 1,
+        n = ((w + 2 * r + k - 1) / k) * k; // Padded length, multiple of k
+    pad.resize(n);
+    g.resize(2 * n);
+    h.resize(2 * n);
+    for (int j = 0; j < n; ++j)
+        pad[j] = in[std::min(std::max(j - r, 0), w - 1)];
+
+    // Prefix (g) and suffix (h) extrema inside each block.
+    float
+        *gMin = g.data(), *gMax = gMin + n,
+        *hMin = h.data(), *hMax = hMin + n;
+    for (int b = 0; b < n; b += k)
+    {
+        gMin[b] = gMax[b] = pad[b];
+        for (int j = b + 1; j < b + k; ++j)
+        {
+            gMin[j] = std::min(gMin[j - 1], pad[j]);
+            gMax[j] = std::max(gMax[j - 1], pad[j]);
+        }
+        hMin[b + k - 1] = hMax[b + k - 1] = pad[b + k - 1];
+        for (int j = b + k - 2; j >= b; --j)
+        {
+            hMin[j] = std::min(hMin[j + 1], pad[j]);
+            hMax[j] = std::max(hMax[j + 1], pad[j]);
+        }
+    }
+
+    // The window [x, x + 2r] of the padded row spans at most two blocks.
+    for (int x = 0; x < w; ++x)
+    {
+        outMin[x] = std::min(hMin[x], gMin[x + 2 * r]);
+        outMax[x] = std::max(hMax[x], gMax[x + 2 * r]);
+    }
+}
+
+/*
+  Bernsen threshold: (max + min) / 2 over the window if max - min > cmin,
+  0 otherwise (as in bernsen.cpp).
+  imgIn     : Input image (first channel)
+  r         : Half size of the window
+  cmin      : Lower bound for the contrast
+  nbThreads : Number of threads
+*/
+CImg<> Bernsen(const CImg<> &imgIn, int r, float cmin, unsigned int nbThreads)
+{
+    int
+        w = imgIn.width(),
+        h = imgIn.height(),
+        k = 2 * r + 1;
+    CImg<> rowMin(w, h), rowMax(w, h), imgOut(w, h);
+
+    // Horizontal pass.
+    ParallelFor(h, nbThreads, [&, w, r](int y0, int y1)
+                {
+                    std::vector<float> pad, g, hb;
+                    for (int y = y0; y < y1; ++y)
+                        RunningMinMaxRow(imgIn.data(0, y), w, r, rowMin.data(0, y), rowMax.data(0, y), pad, g, hb);
+                });
+
+    // Vertical pass on whole rows, one block of k output rows at a time: the
+    // window of output row B k + i covers the suffix from row i of block B
+    // and the prefix up to row i - 1 of block B + 1 (padded row indices).
+    int nbBlocks = (h + k - 1) / k;
+    ParallelFor(nbBlocks, nbThreads, [&, w, h, r, k](int b0, int b1)
+                {
+                    CImg<> suffixMin(w, k), suffixMax(w, k), prefixMin(w, k), prefixMax(w, k);
+                    auto source = [&](int j) { return std::min(std::max(j - r, 0), h - 1); };
+                    for (int B = b0; B < b1; ++B)
+                    {
+                        int j0 = B * k;
+                        std::copy(rowMin.data(0, source(j0 + k - 1)), rowMin.data(0, source(j0 + k - 1)) + w, suffixMin.data(0, k - 1));
+                        std::copy(rowMax.data(0, source(j0 + k - 1)), rowMax.data(0, source(j0 + k - 1)) + w, suffixMax.data(0, k - 1));
+                        for (int i = k - 2; i >= 0; --i)
+                        {
+                            const float *inMin = rowMin.data(0, source(j0 + i)), *inMax = rowMax.data(0, source(j0 + i));
+                            float
+                                *sMin = suffixMin.data(0, i), *sMax = suffixMax.data(0, i),
+                                *nMin = sMin + w, *nMax = sMax + w;
+                            for (int x = 0; x < w; ++x)
+                            {
+                                sMin[x] = std::min(nMin[x], inMin[x]);
+                                sMax[x] = std::max(nMax[x], inMax[x]);
+                            }
+                        }
+                        std::copy(rowMin.data(0, source(j0 + k)), rowMin.data(0, source(j0 + k)) + w, prefixMin.data(0, 0));
+                        std::copy(rowMax.data(0, source(j0 + k)), rowMax.data(0, source(j0 + k)) + w, prefixMax.data(0, 0));
+                        for (int i = 1; i < k - 1; ++i)
+                        {
+                            const float *inMin = rowMin.data(0, source(j0 + k + i)), *inMax = rowMax.data(0, source(j0 + k + i));
+                            float
+                                *pMin = prefixMin.data(0, i), *pMax = prefixMax.data(0, i),
+                                *qMin = pMin - w, *qMax = pMax - w;
+                            for (int x = 0; x < w; ++x)
+                            {
+                                pMin[x] = std::min(qMin[x], inMin[x]);
+                                pMax[x] = std::max(qMax[x], inMax[x]);
+                            }
+                        }
+
+                        for (int i = 0; i < k && j0 + i < h; ++i)
+                        {
+                            const float
+                                *sMin = suffixMin.data(0, i), *sMax = suffixMax.data(0, i),
+                                *pMin = prefixMin.data(0, std::max(i - 1, 0)), *pMax = prefixMax.data(0, std::max(i - 1, 0));
+                            float *out = imgOut.data(0, j0 + i);
+                            bool wholeBlock = i == 0;
+                            for (int x = 0; x < w; ++x)
+                            {
+                                float
+                                    vmin = wholeBlock ? sMin[x] : std::min(sMin[x], pMin[x]),
+                                    vmax = wholeBlock ? sMax[x] : std::max(sMax[x], pMax[x]);
+                                out[x] = vmax - vmin > cmin ? (vmax + vmin) / 2 : 0;
+                            }
+                        }
+                    }
+                });
+    return imgOut;
+}
+
+/*
+  Integral images of I and I^2, with a zero first row and column.
+  imgIn     : Input image (first channel)
+  S, S2     : Output integral images
+  nbThreads : Number of threads
+*/
+void IntegralImages(const CImg<> &imgIn, CImg<double> &S, CImg<double> &S2, unsigned int nbThreads)
+{
+    int
+        w = imgIn.width(),
+        h = imgIn.height();
+    S.assign(w + 1, h + 1, 1, 1, 0);
+    S2.assign(w + 1, h + 1, 1, 1, 0);
+
+    // Cumulative sums along the rows (in parallel), then down the columns
+    // (in parallel over ranges of columns, still reading whole row segments).
+    ParallelFor(h, nbThreads, [&, w](int y0, int y1)
+                {
+                    for (int y = y0; y < y1; ++y)
+                    {
+                        const float *in = imgIn.data(0, y);
+                        double *s = S.data(0, y + 1), *s2 = S2.data(0, y + 1), sum = 0, sum2 = 0;
+                        for (int x = 0; x < w; ++x)
+                        {
+                            sum += in[x];
+                            sum2 += (double)in[x] * in[x];
+                            s[x + 1] = sum;
+                            s2[x + 1] = sum2;
+                        }
+                    }
+                });
+    ParallelFor(w + 1, nbThreads, [&, h](int x0, int x1)
+                {
+                    for (int y = 1; y <= h; ++y)
+                    {
+                        double
+                            *s = S.data(0, y), *up = S.data(0, y - 1),
+                            *s2 = S2.data(0, y), *up2 = S2.data(0, y - 1);
+                        for (int x = x0; x < x1; ++x)
+                        {
+                            s[x] += up[x];
+                            s2[x] += up2[x];
+                        }
+                    }
+                });
+}
+
+/*
+  Niblack (T = m + k s) or Sauvola (T = m (1 + k (s / R - 1))) threshold,
+  with the mean m and standard deviation s of the window clipped to the image.
+  imgIn     : Input image (first channel)
+  r         : Half size of the window
+  k         : Weight of the standard deviation
+  R         : Dynamic range of the standard deviation (Sauvola), 0 for Niblack
+  nbThreads : Number of threads
+*/
+CImg<> NiblackSauvola(const CImg<> &imgIn, int r, float k, float R, unsigned int nbThreads)
+{
+    int
+        w = imgIn.width(),
+        h = imgIn.height();
+    CImg<double> S, S2;
+    IntegralImages(imgIn, S, S2, nbThreads);
+
+    std::vector<int> x0(w), x1(w);
+    for (int x = 0; x < w; ++x)
+    {
+        x0[x] = std::max(0, x - r);
+        x1[x] = std::min(w, x + r + 1);
+    }
+    CImg<> imgOut(w, h);
+    bool sauvola = R > 0;
+    ParallelFor(h, nbThreads, [&, w, h, r, k, R, sauvola](int yStart, int yEnd)
+                {
+                    for (int y = yStart; y < yEnd; ++y)
+                    {
+                        int
+                            ya = std::max(0, y - r),
+                            yb = std::min(h, y + r + 1);
+                        const double
+                            *top = S.data(0, ya), *bottom = S.data(0, yb),
+                            *top2 = S2.data(0, ya), *bottom2 = S2.data(0, yb);
+                        float *out = imgOut.data(0, y);
+                        for (int x = 0; x < w; ++x)
+                        {
+                            int a = x0[x], b = x1[x];
+                            double
+                                area = (double)(b - a) * (yb - ya),
+                                m = (bottom[b] - bottom[a] - top[b] + top[a]) / area,
+                                m2 = (bottom2[b] - bottom2[a] - top2[b] + top2[a]) / area,
+                                s = std::sqrt(std::max(m2 - m * m, 0.0));
+                            out[x] = (float)(sauvola ? m * (1 + k * (s / R - 1)) : m + k * s);
+                        }
+                    }
+                });
+    return imgOut;
+}
+
+/*
+  Reference implementation, copied from bernsen.cpp for the benchmark.
+*/
+CImg<> BernsenReference(CImg<> &imgIn, float cmin)
+{
+    CImg<> imgOut(imgIn.width(), imgIn.height(), 1, 1, 0);
+    float thresholdValue = 0;
+    CImg<> neighborhood(5, 5);
+    cimg_for5x5(imgIn, x, y, 0, 0, neighborhood, float)
+    {
+        float minPixelValue, maxPixelValue;
+        maxPixelValue = neighborhood.max_min(minPixelValue);
+        if (maxPixelValue - minPixelValue > cmin)
+            imgOut(x, y) = (maxPixelValue + minPixelValue) / 2;
+        else
+            imgOut(x, y) = thresholdValue;
+    }
+    return imgOut;
+}
+
+int main()
+{
+    unsigned int nbThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Same result as bernsen.cpp with a 5x5 window.
+    CImg<> img("../images/mountain.png");
+    img.norm().blur(0.75f);
+    CImg<> ref = BernsenReference(img, 40.0f), fast = Bernsen(img, 2, 40.0f, nbThreads);
+    std::cout << "Maximal difference with bernsen.cpp (5x5): " << (ref - fast).abs().max() << std::endl;
+
+    // Synthetic scanned page (A4 at 300 dpi) with uneven illumination.
+    CImg<> page("../images/words_and_shapes.png");
+    page.norm().resize(2480, 3508, 1, 1, 3).normalize(0, 255);
+    cimg_forXY(page, x, y) page(x, y) = page(x, y) * (0.4f + 0.6f * x / page.width()) + 40.0f * y / page.height();
+
+    for (int window : {31, 61, 101})
+    {
+        int r = window / 2;
+        auto t0 = std::chrono::steady_clock::now();
+        CImg<> bernsen = Bernsen(page, r, 15.0f, nbThreads);
+        auto t1 = std::chrono::steady_clock::now();
+        CImg<> niblack = NiblackSauvola(page, r, -0.2f, 0, nbThreads);
+        auto t2 = std::chrono::steady_clock::now();
+        CImg<> sauvola = NiblackSauvola(page, r, 0.2f, 128, nbThreads);
+        auto t3 = std::chrono::steady_clock::now();
+        std::cout << window << "x" << window << " window: Bernsen " << std::chrono::duration<double>(t1 - t0).count() * 1000
+                  << " ms, Niblack " << std::chrono::duration<double>(t2 - t1).count() * 1000
+                  << " ms, Sauvola " << std::chrono::duration<double>(t3 - t2).count() * 1000 << " ms ("
+                  << nbThreads << " threads)" << std::endl;
+        if (window == 61)
+        {
+            CImg<unsigned char> binary(page.width(), page.height());
+            cimg_forXY(page, x, y) binary(x, y) = page(x, y) > sauvola(x, y) ? 255 : 0;
+            binary.get_resize(620, 877, 1, 1, 2).save_png("./results/local_threshold_sauvola.png");
+            page.get_resize(620, 877, 1, 1, 2).normalize(0, 255).save_png("./results/local_threshold_input.png");
+        }
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    BernsenReference(page, 15.0f);
+    auto t1 = std::chrono::steady_clock::now();
+    std::cout << "bernsen.cpp (5x5 window): " << std::chrono::duration<double>(t1 - t0).count() * 1000 << " ms" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,301 @@
+/*
+    Otsu's algorithm in O(L), and multi-level Otsu
+
+    The between-class variance of a threshold t only needs the number of
+    pixels w(t) and the first moment m(t) of the bins up to t, which are
+    accumulated while t increases:
+        sigma_B^2(t) = (m_T w(t) - N m(t))^2 / (w(t) (N - w(t)))
+    Counts are 64-bit integers, and the histogram is built by several
+    threads, each with its own copy. With several thresholds, maximizing the
+    between-class variance amounts to minimizing the within-class variance,
+    which is solved exactly by dynamic programming over the bins. The best
+    split points are monotone, so each layer of the dynamic program is
+    computed by divide and conquer, in O(K L log L) for K thresholds. This
+    makes 16-bit histograms (L = 65536) practical.
+*/
+
+#define cimg_use_png
+#include "CImg.h"
+
+#include <chrono>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>
+
+using namespace cimg_library;
+
+/*
+  Histogram with 64-bit counts, built in parallel. As in CImg::histogram(),
+  the value v falls in bin (v - vmin) * nbLevels / (vmax - vmin).
+  imgIn      : Input image
+  nbLevels   : Number of bins
+  vmin, vmax : Range of the histogram
+  nbThreads  : Number of threads (each one counts a part of the pixels)
+*/
+template <typename T>
+std::vector<uint64_t> Histogram(const CImg<T> &imgIn, int nbLevels, double vmin, double vmax, unsigned int nbThreads)
+{
+    nbThreads = std::max(1u, nbThreads);
+    std::vector<std::vector<uint64_t>> partial(nbThreads, std::vector<uint64_t>(nbLevels, 0));
+    double scale = vmax > vmin ? nbLevels / (vmax - vmin) : 0;
+    size_t n = imgIn.size();
+    auto count = [&, nbLevels, vmin, scale](size_t first, size_t last, unsigned int t)
+    {
+        uint64_t *hist = partial[t].data();
+        const T *data = imgIn.data();
+        for (size_t i = first; i < last; ++i)
+        {
+            double v = (double)data[i];
+            if (v < vmin || v > vmax)
+                continue;
+            int bin = (int)((v - vmin) * scale);
+            ++hist[bin < nbLevels ? bin : nbLevels - 1];
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(count, n * t / nbThreads, n * (t + 1) / nbThreads, t);
+    for (auto &wk : workers)
+        wk.join();
+
+    std::vector<uint64_t> histogram(nbLevels, 0);
+    for (auto &hist : partial)
+        for (int i = 0; i < nbLevels; ++i)
+            histogram[i] += hist[i];
+    return histogram;
+}
+
+/*
+  Otsu threshold of a histogram, in O(L). Bins up to the returned threshold
+  are the background (-1 if the histogram has a single non-empty bin).
+  histogram : Histogram
+*/
+int OtsuThreshold(const std::vector<uint64_t> &histogram)
+{
+    int L = (int)histogram.size();
+    uint64_t N = 0;
+    double mT = 0;
+    for (int i = 0; i < L; ++i)
+    {
+        N += histogram[i];
+        mT += (double)i * histogram[i];
+    }
+
+    uint64_t w = 0;
+    double m = 0, maxVariance = 0;
+    int threshold = -1;
+    for (int t = 0; t < L - 1; ++t)
+    {
+        w += histogram[t];
+        m += (double)t * histogram[t];
+        if (w == 0 || w == N)
+            continue;
+        double
+            diff = mT * w - (double)N * m,
+            variance = diff * diff / ((double)w * (N - w));
+        if (variance > maxVariance)
+        {
+            maxVariance = variance;
+            threshold = t;
+        }
+    }
+    return threshold;
+}
+
+/*
+  Multi-level Otsu: the K thresholds maximizing the between-class variance
+  of the K + 1 classes. Class j holds the bins (t[j - 1], t[j]].
+  histogram : Histogram
+  K         : Number of thresholds
+*/
+std::vector<int> MultiOtsu(const std::vector<uint64_t> &histogram, int K)
+{
+    int L = (int)histogram.size();
+    if (K < 1 || K >= L)
+        return std::vector<int>();
+
+    // Cumulative zeroth and first moments: the cost of the class [u, v] is
+    // -S^2 / P, its within-class variance up to terms that do not depend on
+    // the thresholds.
+    std::vector<double> P(L + 1, 0), S(L + 1, 0);
+    for (int i = 0; i < L; ++i)
+    {
+        P[i + 1] = P[i] + histogram[i];
+        S[i + 1] = S[i] + (double)i * histogram[i];
+    }
+    auto cost = [&](int u, int v)
+    {
+        double p = P[v + 1] - P[u], s = S[v + 1] - S[u];
+        return p > 0 ? -s * s / p : 0.0;
+    };
+
+    // D[k][v]: best cost of the bins [0, v] split into k + 1 classes, and
+    // first bin of the last class.
+    const double inf = std::numeric_limits<double>::infinity();
+    std::vector<std::vector<double>> D(K + 1, std::vector<double>(L, inf));
+    std::vector<std::vector<int>> first(K + 1, std::vector<int>(L, 0));
+    for (int v = 0; v < L; ++v)
+        D[0][v] = cost(0, v);
+
+    // Divide and conquer: the best first bin of the last class is monotone in v.
+    struct Range
+    {
+        int vlo, vhi, ulo, uhi;
+    };
+    for (int k = 1; k <= K; ++k)
+    {
+        std::vector<Range> ranges = {{k, L - 1, k, L - 1}};
+        while (!ranges.empty())
+        {
+            Range r = ranges.back();
+            ranges.pop_back();
+            if (r.vlo > r.vhi)
+                continue;
+            int v = (r.vlo + r.vhi) / 2, best = r.ulo;
+            double bestCost = inf;
+            for (int u = r.ulo; u <= std::min(v, r.uhi); ++u)
+            {
+                double c = D[k - 1][u - 1] + cost(u, v);
+                if (c < bestCost)
+                {
+                    bestCost = c;
+                    best = u;
+                }
+            }
+            D[k][v] = bestCost;
+            first[k][v] = best;
+            ranges.push_back({r.vlo, v - 1, r.ulo, best});
+            ranges.push_back({v + 1, r.vhi, best, r.uhi});
+        }
+    }
+
+    // Backtracking.
+    std::vector<int> thresholds(K);
+    for (int k = K, v = L - 1; k >= 1; --k)
+    {
+        v = first[k][v] - 1;
+        thresholds[k - 1] = v;
+    }
+    return thresholds;
+}
+
+/*
+  Reference implementation, copied from otsu.cpp for the benchmark.
+*/
+float Otsu(CImg<> &imgIn, int nb_levels)
+{
+    float max_variance = 0;
+    long num_background_pixels = 0, num_foreground_pixels;
+    int optimal_threshold = -1;
+    CImg<> histogram = imgIn.get_histogram(nb_levels);
+    cimg_forX(histogram, i)
+    {
+        if (i < nb_levels - 1)
+        {
+            num_background_pixels += histogram[i];
+            num_foreground_pixels = imgIn.size() - num_background_pixels;
+            float background_mean = 0, foreground_mean = 0;
+            for (int j = 0; j <= i; ++j)
+                background_mean += j * histogram[j];
+            background_mean /= num_background_pixels;
+            for (int j = i + 1; j < nb_levels; ++j)
+                foreground_mean += j * histogram[j];
+            foreground_mean /= num_foreground_pixels;
+            if (num_background_pixels * num_foreground_pixels > 0)
+            {
+                float variance = num_background_pixels * num_foreground_pixels * cimg::sqr(background_mean - foreground_mean);
+                if (variance > max_variance)
+                {
+                    max_variance = variance;
+                    optimal_threshold = i;
+                }
+            }
+        }
+    }
+    return (float)optimal_threshold;
+}
+
+int main()
+{
+    unsigned int nbThreads = std::max(1u, std::thread::hardware_concurrency());
+    CImg<> img("../images/bay.png");
+    img.norm().blur(0.75f).resize(512, 256);
+
+    // 8 bits: same threshold as otsu.cpp.
+    std::vector<uint64_t> hist8 = Histogram(img, 256, img.min(), img.max(), nbThreads);
+    std::cout << "Threshold (256 levels): " << OtsuThreshold(hist8)
+              << ", otsu.cpp: " << Otsu(img, 256) << std::endl;
+
+    // 16 bits: a full-range histogram of 65536 levels.
+    CImg<unsigned short> img16 = img.get_normalize(0, 65535);
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<uint64_t> hist16 = Histogram(img16, 65536, 0, 65535, nbThreads);
+    int threshold16 = OtsuThreshold(hist16);
+    auto t1 = std::chrono::steady_clock::now();
+    CImg<> img16f(img16);
+    float reference16 = Otsu(img16f, 65536);
+    auto t2 = std::chrono::steady_clock::now();
+    std::cout << "Threshold (65536 levels): " << threshold16 << " in "
+              << std::chrono::duration<double>(t1 - t0).count() * 1000 << " ms, otsu.cpp: " << reference16 << " in "
+              << std::chrono::duration<double>(t2 - t1).count() * 1000 << " ms" << std::endl;
+
+    // Multi-level: the single threshold is the same as Otsu's, and the
+    // two-threshold result is checked against an exhaustive search.
+    std::cout << "Multi-level, K = 1: " << MultiOtsu(hist8, 1)[0] << std::endl;
+    std::vector<int> t2k = MultiOtsu(hist8, 2);
+    double bestVariance = -1;
+    int best1 = 0, best2 = 0;
+    for (int a = 0; a < 255; ++a)
+        for (int b = a + 1; b < 255; ++b)
+        {
+            double variance = 0;
+            int bounds[4] = {-1, a, b, 255};
+            for (int c = 0; c < 3; ++c)
+            {
+                double p = 0, s = 0;
+                for (int i = bounds[c] + 1; i <= bounds[c + 1]; ++i)
+                {
+                    p += hist8[i];
+                    s += (double)i * hist8[i];
+                }
+                if (p > 0)
+                    variance += s * s / p;
+            }
+            if (variance > bestVariance)
+            {
+                bestVariance = variance;
+                best1 = a;
+                best2 = b;
+            }
+        }
+    std::cout << "Multi-level, K = 2: " << t2k[0] << ", " << t2k[1]
+              << " (exhaustive search: " << best1 << ", " << best2 << ")" << std::endl;
+
+    for (int K = 2; K <= 4; ++K)
+    {
+        t0 = std::chrono::steady_clock::now();
+        std::vector<int> thresholds = MultiOtsu(hist16, K);
+        t1 = std::chrono::steady_clock::now();
+        std::cout << "Multi-level, K = " << K << ", 65536 levels:";
+        for (int t : thresholds)
+            std::cout << " " << t;
+        std::cout << " (" << std::chrono::duration<double>(t1 - t0).count() * 1000 << " ms)" << std::endl;
+    }
+
+    // Segmentation in 4 classes.
+    std::vector<int> thresholds = MultiOtsu(hist8, 3);
+    float scale = 256 / (img.max() - img.min()), vmin = img.min();
+    CImg<> imgOut(img.width(), img.height(), 1, 1, 0);
+    cimg_forXY(img, x, y)
+    {
+        int bin = std::min(255, (int)((img(x, y) - vmin) * scale));
+        imgOut(x, y) = (float)(std::upper_bound(thresholds.begin(), thresholds.end(), bin - 1) - thresholds.begin());
+    }
+    imgOut.normalize(0, 255).save_png("./results/otsu_multilevel.png");
+
+    return 0;
+}
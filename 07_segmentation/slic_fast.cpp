@@ -0,0 +1,829 @@
+/*
+    SLIC superpixels, parallel engine
+
+    get_labels in slic.cpp goes over the centroids one after the other, and
+    builds a Pixel and calls std::pow five times for each tested pixel. Then
+    the pixels out of every window are tested against all the centroids, and
+    recompute_centroids goes over the image again. Here:
+    - The Lab image is interleaved by rows (the L, a and b rows of an image
+      row are contiguous, so that the distances vectorize), the centroids
+      are rows (x, y, L, a, b), and the spatial weight (m / S)^2 is computed
+      once.
+    - Each centroid comes from a cell of the initial grid, and its window is
+      clipped to its cell grown by S on each side. The rows of the grid are
+      colored with 3 colors: the clipped windows of two rows of the same
+      color never overlap, so the rows of a color are processed in parallel
+      without conflicts on the labels.
+    - The pixels around a row of the last color are final as soon as this
+      row is processed: their sums for the next centroids are accumulated
+      in the same pass, while they are still in the cache (per-thread sums).
+    - Pixels out of every window stay unlabeled. At the end, the connectivity
+      is enforced: each connected region of a label smaller than a quarter
+      of a superpixel, or unlabeled, is merged into a neighboring region.
+
+    For a video, each frame starts from the centroids and labels of the
+    previous one, and only the cells of the grid where the Lab values
+    changed are assigned again, within a latency budget.
+*/
+
+#define cimg_use_png
+#include "CImg.h"
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+using namespace cimg_library;
+
+// Parameters of SLIC.
+struct SLICParams
+{
+    float S;             // Superpixel size
+    float m;             // Compactness factor
+    int maxIterations;
+    float minResidual;   // Stop when the mean L1 motion of the centroids is below
+    unsigned int nbThreads;
+};
+
+// Superpixels: labels and centroids (x, y, L, a, b) of each label.
+struct Superpixels
+{
+    CImg<int> labels;
+    CImg<> centroids; // (5, K)
+    int iterations;
+};
+
+/*
+  Lab conversion of an RGB image, interleaved by rows as (width, 3, height):
+  the L, a and b rows of an image row are contiguous. Bands of rows are
+  converted in parallel.
+*/
+CImg<> InterleavedLab(const CImg<> &img, unsigned int nbThreads)
+{
+    nbThreads = std::max(1u, nbThreads);
+    int
+        w = img.width(),
+        h = img.height();
+    CImg<> lab(w, 3, h);
+    auto convert = [&, w](int y0, int y1)
+    {
+        if (y0 >= y1)
+            return;
+        CImg<> band = img.get_rows(y0, y1 - 1).channels(0, 2).RGBtoLab();
+        for (int y = y0; y < y1; ++y)
+            for (int c = 0; c < 3; ++c)
+                std::copy(band.data(0, y - y0, 0, c), band.data(0, y - y0, 0, c) + w, lab.data(0, c, y));
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(convert, (int)((long long)h * t / nbThreads), (int)((long long)h * (t + 1) / nbThreads));
+    for (auto &wk : workers)
+        wk.join();
+    return lab;
+}
+
+/*
+  Initial centroids on a grid of cells of size S, each one at the point of
+  minimal gradient of its cell, as in slic.cpp. The gradient (centered
+  differences of L, a and b) is computed row by row, and the rows of cells
+  are processed in parallel.
+  lab       : Interleaved Lab image (width, 3, height)
+  S         : Superpixel size
+  gx, gy    : Output, size of the grid (centroid k is in cell (k % gx, k / gx))
+  nbThreads : Number of threads
+*/
+CImg<> GridCentroids(const CImg<> &lab, float S, int &gx, int &gy, unsigned int nbThreads)
+{
+    nbThreads = std::max(1u, nbThreads);
+    int
+        w = lab.width(),
+        h = lab.depth();
+    gx = std::max(1, (int)cimg::round(w / S));
+    gy = std::max(1, (int)cimg::round(h / S));
+    CImg<> centroids(5, gx * gy);
+
+    auto cells = [&, w, h, S](int cy0, int cy1)
+    {
+        std::vector<float> grad2(w), best(gx);
+        std::vector<int> bestX(gx), bestY(gx);
+        for (int cy = cy0; cy < cy1; ++cy)
+        {
+            std::fill(best.begin(), best.end(), std::numeric_limits<float>::max());
+            int
+                y0 = std::min((int)(cy * S), h - 1),
+                y1 = std::min((int)(cy * S) + (int)S - 1, h - 1);
+            for (int y = y0; y <= y1; ++y)
+            {
+                std::fill(grad2.begin(), grad2.end(), 0.0f);
+                for (int c = 0; c < 3; ++c)
+                {
+                    const float
+                        *row = lab.data(0, c, y),
+                        *prev = lab.data(0, c, std::max(y - 1, 0)),
+                        *next = lab.data(0, c, std::min(y + 1, h - 1));
+                    for (int x = 0; x < w; ++x)
+                    {
+                        float
+                            gxv = (row[std::min(x + 1, w - 1)] - row[std::max(x - 1, 0)]) / 2,
+                            gyv = (next[x] - prev[x]) / 2;
+                        grad2[x] += gxv * gxv + gyv * gyv;
+                    }
+                }
+                for (int cx = 0; cx < gx; ++cx)
+                {
+                    int
+                        x0 = std::min((int)(cx * S), w - 1),
+                        x1 = std::min((int)(cx * S) + (int)S - 1, w - 1);
+                    for (int x = x0; x <= x1; ++x)
+                        if (grad2[x] < best[cx])
+                        {
+                            best[cx] = grad2[x];
+                            bestX[cx] = x;
+                            bestY[cx] = y;
+                        }
+                }
+            }
+            for (int cx = 0; cx < gx; ++cx)
+            {
+                int k = cx + cy * gx;
+                centroids(0, k) = (float)bestX[cx];
+                centroids(1, k) = (float)bestY[cx];
+                for (int c = 0; c < 3; ++c)
+                    centroids(2 + c, k) = lab(bestX[cx], c, bestY[cx]);
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(cells, (int)((long long)gy * t / nbThreads), (int)((long long)gy * (t + 1) / nbThreads));
+    for (auto &wk : workers)
+        wk.join();
+    return centroids;
+}
+
+/*
+  One assignment of the pixels to the centroids, fused with the computation
+  of the next centroids.
+  lab        : Interleaved Lab image (width, 3, height)
+  centroids  : Centroids (5, K), replaced by the next ones
+  gx, gy     : Size of the grid
+  S          : Superpixel size
+  spatial    : Weight (m / S)^2 of the squared spatial distance
+  labels     : Output, label of each pixel (-1 if out of every window)
+  distances  : Work buffer, distance of each pixel to its centroid
+  nbThreads  : Number of threads
+  dirty      : Cells of the grid to assign (gx, gy), the others keep their
+               labels (all the cells if null)
+  Returns the mean L1 motion of the centroids.
+*/
+float AssignPixels(const CImg<> &lab, CImg<> &centroids, int gx, int gy, float S, float spatial,
+                   CImg<int> &labels, CImg<> &distances, unsigned int nbThreads,
+                   const CImg<unsigned char> *dirty = 0)
+{
+    nbThreads = std::max(1u, nbThreads);
+    int
+        w = lab.width(),
+        h = lab.depth(),
+        K = centroids.height();
+
+    // Pixels of a cell (the last row and column of cells reach the borders).
+    auto cellStart = [S](int cx) { return (int)(cx * S); };
+    auto cellX1 = [&, S, w](int cx) { return cx == gx - 1 ? w - 1 : (int)((cx + 1) * S) - 1; };
+    auto cellY1 = [&, S, h](int cy) { return cy == gy - 1 ? h - 1 : (int)((cy + 1) * S) - 1; };
+    if (!dirty)
+    {
+        labels.assign(w, h).fill(-1);
+        distances.assign(w, h).fill(std::numeric_limits<float>::max());
+    }
+    else
+        cimg_forXY(*dirty, cx, cy) if ((*dirty)(cx, cy))
+        {
+            for (int y = cellStart(cy); y <= cellY1(cy); ++y)
+            {
+                std::fill(labels.data(cellStart(cx), y), labels.data(cellX1(cx) + 1, y), -1);
+                std::fill(distances.data(cellStart(cx), y), distances.data(cellX1(cx) + 1, y),
+                          std::numeric_limits<float>::max());
+            }
+        }
+
+    // Distances to centroid k in a rectangle. Both sides of the selects are
+    // computed, so that the loop vectorizes.
+    auto scan = [&](int k, int x0, int y0, int x1, int y1)
+    {
+        const float
+            X = centroids(0, k), Y = centroids(1, k),
+            L = centroids(2, k), A = centroids(3, k), B = centroids(4, k);
+        for (int y = y0; y <= y1; ++y)
+        {
+            const float
+                *pL = lab.data(x0, 0, y),
+                *pA = lab.data(x0, 1, y),
+                *pB = lab.data(x0, 2, y);
+            float
+                *dist = distances.data(x0, y),
+                dy2 = (y - Y) * (y - Y),
+                fx = x0 - X;
+            int
+                *label = labels.data(x0, y),
+                len = x1 - x0 + 1;
+            for (int i = 0; i < len; ++i)
+            {
+                float
+                    dL = pL[i] - L, dA = pA[i] - A, dB = pB[i] - B,
+                    dx = fx + i,
+                    d = dL * dL + dA * dA + dB * dB + spatial * (dx * dx + dy2),
+                    o = dist[i];
+                int previous = label[i];
+                dist[i] = std::min(d, o);
+                label[i] = d < o ? k : previous;
+            }
+        }
+    };
+
+    // Window of centroid k, clipped to its cell grown by S, and restricted to
+    // the dirty cells if any.
+    auto assign = [&, w, h, S](int k)
+    {
+        int
+            cx = k % gx, cy = k / gx,
+            x0 = std::max({(int)(centroids(0, k) - S), (int)((cx - 1) * S), 0}),
+            y0 = std::max({(int)(centroids(1, k) - S), (int)((cy - 1) * S), 0}),
+            x1 = std::min({(int)(centroids(0, k) + S - 1), (int)((cx + 2) * S) - 1, w - 1}),
+            y1 = std::min({(int)(centroids(1, k) + S - 1), (int)((cy + 2) * S) - 1, h - 1});
+        if (!dirty)
+        {
+            scan(k, x0, y0, x1, y1);
+            return;
+        }
+        for (int ny = std::max(cy - 1, 0); ny <= std::min(cy + 1, gy - 1); ++ny)
+            for (int nx = std::max(cx - 1, 0); nx <= std::min(cx + 1, gx - 1); ++nx)
+                if ((*dirty)(nx, ny))
+                {
+                    int
+                        rx0 = std::max(x0, cellStart(nx)), rx1 = std::min(x1, cellX1(nx)),
+                        ry0 = std::max(y0, cellStart(ny)), ry1 = std::min(y1, cellY1(ny));
+                    if (rx0 <= rx1 && ry0 <= ry1)
+                        scan(k, rx0, ry0, rx1, ry1);
+                }
+    };
+
+    // Per-thread sums (x, y, L, a, b, count) of the pixels of each centroid.
+    std::vector<CImg<double>> sums(nbThreads, CImg<double>(6, K, 1, 1, 0));
+    auto accumulate = [&, w](int y0, int y1, CImg<double> &sum)
+    {
+        for (int y = y0; y < y1; ++y)
+        {
+            const float
+                *pL = lab.data(0, 0, y),
+                *pA = lab.data(0, 1, y),
+                *pB = lab.data(0, 2, y);
+            const int *label = labels.data(0, y);
+            for (int x = 0; x < w; ++x)
+                if (label[x] >= 0)
+                {
+                    double *s = sum.data(0, label[x]);
+                    s[0] += x;
+                    s[1] += y;
+                    s[2] += pL[x];
+                    s[3] += pA[x];
+                    s[4] += pB[x];
+                    s[5] += 1;
+                }
+        }
+    };
+
+    // Rows of the grid are colored with 3 colors: the windows of two rows of
+    // the same color never overlap, so each row of a color is processed by
+    // one thread, from left to right (the windows of a row share most of
+    // their pixels in the cache). The pixels of cell rows cy - 1 to cy + 1
+    // are final once row cy of the last color is processed, so their sums
+    // are accumulated right away.
+    for (int color = 0; color < 3; ++color)
+    {
+        std::vector<int> rows;
+        for (int cy = color; cy < gy; cy += 3)
+            rows.push_back(cy);
+        int n = (int)rows.size();
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < nbThreads; ++t)
+            workers.emplace_back([&, t, n, color]()
+                                 {
+                                     for (int i = (int)((long long)n * t / nbThreads); i < (long long)n * (t + 1) / nbThreads; ++i)
+                                     {
+                                         int cy = rows[i];
+                                         for (int cx = 0; cx < gx; ++cx)
+                                             assign(cx + cy * gx);
+                                         if (color == 2)
+                                             accumulate(i == 0 ? 0 : (int)((cy - 1) * S),
+                                                        i == n - 1 ? h : std::min(h, (int)((cy + 2) * S)), sums[t]);
+                                     } });
+        for (auto &wk : workers)
+            wk.join();
+    }
+    if (gy < 3)
+        accumulate(0, h, sums[0]);
+
+    // Next centroids (a centroid without pixels does not move).
+    float residual = 0;
+    for (int k = 0; k < K; ++k)
+    {
+        double total[6] = {0, 0, 0, 0, 0, 0};
+        for (auto &sum : sums)
+            for (int c = 0; c < 6; ++c)
+                total[c] += sum(c, k);
+        if (total[5] < 0.5)
+            continue;
+        for (int c = 0; c < 5; ++c)
+        {
+            float next = (float)(total[c] / total[5]);
+            residual += std::abs(next - centroids(c, k));
+            centroids(c, k) = next;
+        }
+    }
+    return residual / K;
+}
+
+/*
+  Connectivity enforcement: the labels are replaced by the connected
+  regions (4-connectivity) of each label. Regions smaller than minSize, and
+  unlabeled pixels, are merged into the region met just before them in scan
+  order. Returns the number of regions.
+  labels  : Labels (-1 for unlabeled pixels), replaced by the regions
+  minSize : Minimal size of a region
+*/
+int EnforceConnectivity(CImg<int> &labels, int minSize)
+{
+    int
+        w = labels.width(),
+        h = labels.height(),
+        n = w * h,
+        nbRegions = 0;
+    CImg<int> regions(w, h, 1, 1, -1);
+    const int *label = labels.data();
+    int *region = regions.data();
+    std::vector<int> members;
+    for (int start = 0; start < n; ++start)
+    {
+        if (region[start] >= 0)
+            continue;
+        int
+            l = label[start],
+            x = start % w,
+            adjacent = x > 0 ? region[start - 1] : (start >= w ? region[start - w] : -1); // Region met before
+
+        // Flood fill of the region: members is also the queue.
+        members.assign(1, start);
+        region[start] = nbRegions;
+        for (size_t m = 0; m < members.size(); ++m)
+        {
+            int i = members[m], px = i % w;
+            if (px > 0 && region[i - 1] < 0 && label[i - 1] == l)
+                region[i - 1] = nbRegions, members.push_back(i - 1);
+            if (px < w - 1 && region[i + 1] < 0 && label[i + 1] == l)
+                region[i + 1] = nbRegions, members.push_back(i + 1);
+            if (i >= w && region[i - w] < 0 && label[i - w] == l)
+                region[i - w] = nbRegions, members.push_back(i - w);
+            if (i < n - w && region[i + w] < 0 && label[i + w] == l)
+                region[i + w] = nbRegions, members.push_back(i + w);
+        }
+        if (adjacent >= 0 && (l < 0 || (int)members.size() < minSize))
+            for (int i : members)
+                region[i] = adjacent;
+        else
+            ++nbRegions;
+    }
+    labels.swap(regions);
+    return nbRegions;
+}
+
+/*
+  Centroids (x, y, L, a, b) of the regions of a label image.
+*/
+CImg<> RegionCentroids(const CImg<> &lab, const CImg<int> &labels, int nbRegions)
+{
+    CImg<double> sums(6, nbRegions, 1, 1, 0);
+    cimg_forXY(labels, x, y)
+    {
+        double *s = sums.data(0, labels(x, y));
+        s[0] += x;
+        s[1] += y;
+        for (int c = 0; c < 3; ++c)
+            s[2 + c] += lab(x, c, y);
+        s[5] += 1;
+    }
+    CImg<> centroids(5, nbRegions);
+    cimg_forXY(centroids, c, k) centroids(c, k) = (float)(sums(c, k) / std::max(sums(5, k), 1.0));
+    return centroids;
+}
+
+/*
+  SLIC superpixels.
+  img    : RGB image
+  params : Parameters
+*/
+Superpixels SLIC(const CImg<> &img, const SLICParams &params)
+{
+    CImg<> lab = InterleavedLab(img, params.nbThreads), distances;
+    int gx, gy;
+    Superpixels sp;
+    CImg<> centroids = GridCentroids(lab, params.S, gx, gy, params.nbThreads);
+    float spatial = params.m * params.m / (params.S * params.S);
+    sp.iterations = 0;
+    float residual;
+    do
+    {
+        residual = AssignPixels(lab, centroids, gx, gy, params.S, spatial, sp.labels, distances, params.nbThreads);
+        ++sp.iterations;
+    } while (residual > params.minResidual && sp.iterations < params.maxIterations);
+
+    int nbRegions = EnforceConnectivity(sp.labels, (int)(params.S * params.S / 4));
+    sp.centroids = RegionCentroids(lab, sp.labels, nbRegions);
+    return sp;
+}
+
+// State of the superpixels of a video, from one frame to the next.
+struct StreamingSLIC
+{
+    SLICParams params;
+    float changeThreshold; // Lab distance above which a pixel has changed
+    double budget;         // Latency budget of a frame, in ms
+    double iterationMs = 0; // Last measured time of an iteration, per fraction of the cells assigned, in ms
+    double finishMs = 0;    // Last measured time of the connectivity and centroids, in ms
+    CImg<> lab;            // Lab image of the last frame
+    CImg<> centroids;      // Centroids of the grid (before connectivity)
+    CImg<int> labels;      // Labels of the grid (before connectivity)
+    CImg<> distances;
+    CImg<unsigned char> pending; // Cells whose centroid has not settled yet
+    int gx, gy;
+};
+
+// Statistics of a frame.
+struct FrameStats
+{
+    int iterations;
+    float dirtyCells; // Fraction of the cells assigned again
+    double ms;
+    bool overBudget;  // The frame took longer than the budget
+};
+
+/*
+  Superpixels of the next frame of a video. The first frame is segmented
+  from scratch. Then, each frame starts from the centroids and labels of
+  the previous one: only the cells of the grid with pixels whose Lab value
+  changed by more than changeThreshold are assigned again. An iteration
+  only starts if the time spent so far (color conversion and change
+  detection), plus the last measured times of an iteration (scaled by the
+  fraction of the cells to assign) and of the final connectivity and
+  centroids, fits in the latency budget: when the fixed costs already
+  exceed it, the frame keeps the previous labels. The iterations also stop
+  after params.maxIterations. The cells not assigned,
+  or whose centroid still moves by more than params.minResidual, are
+  assigned again in the next frame.
+  state : State of the video, updated
+  frame : RGB frame
+  stats : Output, statistics of the frame
+*/
+Superpixels NextFrame(StreamingSLIC &state, const CImg<> &frame, FrameStats &stats)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    auto elapsed = [&t0]()
+    { return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() * 1000; };
+    const SLICParams &params = state.params;
+    float spatial = params.m * params.m / (params.S * params.S);
+    CImg<> lab = InterleavedLab(frame, params.nbThreads);
+    int w = lab.width(), h = lab.depth();
+
+    CImg<unsigned char> dirty;
+    bool first = !state.lab.is_sameXYZC(lab);
+    if (first)
+        state.centroids = GridCentroids(lab, params.S, state.gx, state.gy, params.nbThreads);
+    else
+    {
+        // Cells with at least one changed pixel, by rows of cells in parallel.
+        int gx = state.gx, gy = state.gy;
+        float threshold2 = state.changeThreshold * state.changeThreshold, S = params.S;
+        dirty = state.pending;
+        auto detect = [&, w, h, gx, gy, S, threshold2](int cy0, int cy1)
+        {
+            std::vector<float> diff2(w);
+            for (int cy = cy0; cy < cy1; ++cy)
+            {
+                int y0 = (int)(cy * S), y1 = cy == gy - 1 ? h - 1 : (int)((cy + 1) * S) - 1;
+                for (int y = y0; y <= y1; ++y)
+                {
+                    std::fill(diff2.begin(), diff2.end(), 0.0f);
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        const float *now = lab.data(0, c, y), *before = state.lab.data(0, c, y);
+                        for (int x = 0; x < w; ++x)
+                            diff2[x] += (now[x] - before[x]) * (now[x] - before[x]);
+                    }
+                    for (int x = 0; x < w; ++x)
+                        if (diff2[x] > threshold2)
+                            dirty(std::min((int)(x / S), gx - 1), cy) = 1;
+                }
+            }
+        };
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < std::max(1u, params.nbThreads); ++t)
+            workers.emplace_back(detect, (int)((long long)gy * t / std::max(1u, params.nbThreads)),
+                                 (int)((long long)gy * (t + 1) / std::max(1u, params.nbThreads)));
+        for (auto &wk : workers)
+            wk.join();
+    }
+    state.lab.swap(lab);
+
+    stats.iterations = 0;
+    stats.dirtyCells = first ? 1.0f : (float)dirty.sum() / dirty.size();
+    float residual = 0;
+    CImg<> before;
+    if (first || stats.dirtyCells > 0)
+        while (stats.iterations < params.maxIterations &&
+               (first || elapsed() + state.iterationMs * stats.dirtyCells + state.finishMs <= state.budget))
+        {
+            double start = elapsed();
+            before = state.centroids;
+            residual = AssignPixels(state.lab, state.centroids, state.gx, state.gy, params.S, spatial, state.labels,
+                                    state.distances, params.nbThreads, first ? 0 : &dirty);
+            state.iterationMs = (elapsed() - start) / stats.dirtyCells;
+            ++stats.iterations;
+            if (residual <= params.minResidual)
+                break;
+        }
+
+    // Cells still moving when the iterations stopped, or not assigned at all.
+    state.pending.assign(state.gx, state.gy).fill(0);
+    if (stats.iterations == 0 && !first)
+        state.pending = dirty;
+    else
+        cimg_forY(state.centroids, k)
+        {
+            float motion = 0;
+            for (int d = 0; d < 5; ++d)
+                motion += std::abs(state.centroids(d, k) - before(d, k));
+            if (motion > params.minResidual)
+                state.pending[k] = 1;
+        }
+
+    double finishStart = elapsed();
+    Superpixels sp;
+    sp.labels = state.labels;
+    sp.iterations = stats.iterations;
+    int nbRegions = EnforceConnectivity(sp.labels, (int)(params.S * params.S / 4));
+    sp.centroids = RegionCentroids(state.lab, sp.labels, nbRegions);
+    state.finishMs = elapsed() - finishStart;
+    stats.ms = elapsed();
+    stats.overBudget = !first && stats.ms > state.budget;
+    return sp;
+}
+
+/*
+  Superpixel boundaries on the mean colors, as draw_boundaries in slic.cpp.
+*/
+CImg<unsigned char> DrawBoundaries(const Superpixels &sp)
+{
+    CImg<> colors(sp.centroids.height(), 1, 1, 3);
+    cimg_forX(colors, k) cimg_forC(colors, c) colors(k, 0, 0, c) = sp.centroids(2 + c, k);
+    CImg<unsigned char> visu = sp.labels.get_map(colors).LabtoRGB();
+    CImg<int> N(9);
+    cimg_for3x3(sp.labels, x, y, 0, 0, N, int) if (N[4] != N[1] || N[4] != N[3])
+        visu.fillC(x, y, 0, 0, 0, 0);
+    unsigned char red[] = {255, 0, 0};
+    cimg_forY(sp.centroids, k)
+        visu.draw_circle((int)sp.centroids(0, k), (int)sp.centroids(1, k), 2, red, 0.5f);
+    return visu;
+}
+
+/*
+  Reference implementation, copied from slic.cpp for the benchmark (without
+  the drawing of the boundaries). intialize_centroids reads the initial
+  colors from the Lab image, and clamps the cell centers to the image:
+  slic.cpp reads them from channels 1 and 2 of the gradient norm, which does
+  not have them, and crashes on large images.
+*/
+struct Pixel
+{
+    float x, y, L, a, b;
+};
+
+float D(const Pixel &p1, const Pixel &p2, float S, float m)
+{
+    return std::pow(p1.L - p2.L, 2) + std::pow(p1.a - p2.a, 2) +
+           std::pow(p1.b - p2.b, 2) + m * m / (S * S) * (std::pow(p1.x - p2.x, 2) + std::pow(p1.y - p2.y, 2));
+}
+
+CImg<> get_labels(CImg<> &lab, CImg<> &centroids, float S, float m)
+{
+    CImg<> labels(lab.width(), lab.height(), 1, 2, 1e20);
+    cimg_forX(centroids, k)
+    {
+        Pixel centroid = {centroids(k, 0), centroids(k, 1), centroids(k, 2), centroids(k, 3), centroids(k, 4)};
+        int x0 = std::max((int)(centroid.x - S), 0);
+        int y0 = std::max((int)(centroid.y - S), 0);
+        int x1 = std::min((int)(centroid.x + S - 1), lab.width() - 1);
+        int y1 = std::min((int)(centroid.y + S - 1), lab.height() - 1);
+        cimg_for_inXY(lab, x0, y0, x1, y1, x, y)
+        {
+            Pixel currentPixel = {static_cast<float>(x), static_cast<float>(y), lab(x, y, 0), lab(x, y, 1), lab(x, y, 2)};
+            float dist = D(currentPixel, centroid, S, m);
+            if (dist < labels(x, y, 1))
+            {
+                labels(x, y, 0) = k;
+                labels(x, y, 1) = dist;
+            }
+        }
+    }
+    cimg_forXY(labels, x, y) if (labels(x, y) >= centroids.width())
+    {
+        Pixel currentPixel = {static_cast<float>(x), static_cast<float>(y), lab(x, y, 0), lab(x, y, 1), lab(x, y, 2)};
+        float distmin = 1e20;
+        int kmin = 0;
+        cimg_forX(centroids, k)
+        {
+            Pixel centroid = {centroids(k, 0), centroids(k, 1), centroids(k, 2), centroids(k, 3), centroids(k, 4)};
+            float dist = D(currentPixel, centroid, S, m);
+            if (dist < distmin)
+            {
+                distmin = dist;
+                kmin = k;
+            }
+        }
+        labels(x, y, 0) = kmin;
+        labels(x, y, 1) = distmin;
+    }
+    return labels;
+}
+
+CImg<> intialize_centroids(CImg<> &img, CImg<> &lab, float S)
+{
+    CImg<> centroids(cimg::round(img.width() / S), cimg::round(img.height() / S), 1, 5);
+    int S1 = S / 2;
+    int S2 = S - 1 - S1;
+    cimg_forXY(centroids, x, y)
+    {
+        int
+            xc = std::min(x * S + S1, img.width() - 1.0f),
+            yc = std::min(y * S + S1, img.height() - 1.0f),
+            x0 = std::max(xc - S1, 0),
+            y0 = std::max(yc - S1, 0),
+            x1 = std::min(xc + S2, img.width() - 1),
+            y1 = std::min(yc + S2, img.height() - 1);
+        CImg<> st = img.get_crop(x0, y0, x1, y1).get_stats();
+        centroids(x, y, 0) = x0 + st[4];
+        centroids(x, y, 1) = y0 + st[5];
+        centroids(x, y, 2) = lab(xc, yc, 0, 0);
+        centroids(x, y, 3) = lab(xc, yc, 0, 1);
+        centroids(x, y, 4) = lab(xc, yc, 0, 2);
+    }
+    centroids.resize(centroids.width() * centroids.height(), 1, 1, 5, -1);
+    return centroids;
+}
+
+CImg<> recompute_centroids(const CImg<> &img, const CImg<> &lab, const CImg<> &labels, const CImg<> &centroids)
+{
+    CImg<> next_centroids = centroids.get_fill(0);
+    CImg<> accu(centroids.width(), 1, 1, 1, 0);
+    cimg_forXY(img, x, y)
+    {
+        int k = (int)labels(x, y);
+        next_centroids(k, 0) += x;
+        next_centroids(k, 1) += y;
+        next_centroids(k, 2) += lab(x, y, 0);
+        next_centroids(k, 3) += lab(x, y, 1);
+        next_centroids(k, 4) += lab(x, y, 2);
+        ++accu[k];
+    }
+    accu.max(1e-8f);
+    next_centroids.div(accu);
+    return next_centroids;
+}
+
+int SLICReference(CImg<> &img, float S, float m)
+{
+    if (img.spectrum() == 4)
+        img.channels(0, 2);
+    CImg<> lab = img.get_RGBtoLab();
+    CImgList<> grad = lab.get_gradient("xy");
+    CImg<> grad_norm = (grad > 'c').norm();
+    CImg<> centroids = intialize_centroids(grad_norm, lab, S);
+    float residualError = 0;
+    int iterations = 0;
+    do
+    {
+        CImg<> labels = get_labels(lab, centroids, S, m);
+        CImg<> next_centroids = recompute_centroids(img, lab, labels, centroids);
+        residualError = (next_centroids - centroids).norm(1).sum() / centroids.width();
+        centroids.swap(next_centroids);
+        ++iterations;
+    } while (residualError > 0.25f);
+    get_labels(lab, centroids, S, m);
+    return iterations;
+}
+
+int main()
+{
+    unsigned int nbThreads = std::max(1u, std::thread::hardware_concurrency());
+    const int S = 40; // Superpixel size
+    const int m = 10; // Compactness factor
+
+    CImg<> img("../images/car.png");
+    if (img.spectrum() == 4)
+        img.channels(0, 2);
+    img.blur(2.5f).normalize(0, 255);
+    Superpixels sp = SLIC(img, {S, m, 100, 0.25f, nbThreads});
+    std::cout << "car: " << sp.centroids.height() << " superpixels, " << sp.iterations << " iterations" << std::endl;
+    DrawBoundaries(sp).save_png("./results/slic_fast.png");
+
+    // Larger image (road, 3 times larger), against slic.cpp.
+    CImg<> large("../images/road.png");
+    if (large.spectrum() == 4)
+        large.channels(0, 2);
+    large.resize(large.width() * 3, large.height() * 3, 1, 3, 3).blur(2.5f).normalize(0, 255);
+    for (int s : {20, 40})
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        Superpixels fast = SLIC(large, {(float)s, m, 100, 0.25f, nbThreads});
+        auto t1 = std::chrono::steady_clock::now();
+        int iterations = SLICReference(large, (float)s, m);
+        auto t2 = std::chrono::steady_clock::now();
+        std::cout << large.width() << "x" << large.height() << ", S = " << s << ": " << fast.centroids.height()
+                  << " superpixels, " << fast.iterations << " iterations, "
+                  << std::chrono::duration<double>(t1 - t0).count() * 1000 << " ms (slic.cpp: " << iterations
+                  << " iterations, " << std::chrono::duration<double>(t2 - t1).count() * 1000 << " ms)" << std::endl;
+    }
+
+    // Video: the driveby frames, and a synthetic sequence of a puck sliding
+    // on a still background with sensor noise.
+    std::vector<CImg<>> driveby, sliding;
+    for (int i = 1; i <= 2; ++i)
+    {
+        CImg<> frame(("../images/driveby_" + std::to_string(i) + ".png").c_str());
+        if (frame.spectrum() == 4)
+            frame.channels(0, 2);
+        driveby.push_back(frame.blur(1.0f));
+    }
+    CImg<> background("../images/road.png"), puck("../images/car.png");
+    background.channels(0, 2).resize(640, 480, 1, 3, 3).blur(1.0f);
+    puck.channels(0, 2).resize(96, 96, 1, 3, 3);
+    CImg<> disk(96, 96, 1, 1, 0);
+    float white = 1;
+    disk.draw_circle(48, 48, 47, &white);
+    std::mt19937 rng(42);
+    std::normal_distribution<float> noise(0, 1);
+    for (int i = 0; i < 30; ++i)
+    {
+        CImg<> frame = background;
+        frame.draw_image(40 + 16 * i, 200, 0, 0, puck, disk, 1, 1);
+        cimg_for(frame, p, float) *p = std::min(255.0f, std::max(0.0f, *p + noise(rng)));
+        sliding.push_back(frame);
+    }
+
+    std::vector<std::pair<std::string, std::vector<CImg<>> *>> sequences = {{"driveby", &driveby}, {"sliding puck", &sliding}};
+    for (auto &sequence : sequences)
+    {
+        StreamingSLIC state;
+        state.params = {20, m, 10, 0.25f, nbThreads};
+        state.changeThreshold = 6;
+        state.budget = 60;
+        double streamTotal = 0, streamMax = 0, fullTotal = 0;
+        float dirtyTotal = 0;
+        int iterationsTotal = 0, nbOverBudget = 0, n = (int)sequence.second->size();
+        Superpixels last;
+        for (int i = 0; i < n; ++i)
+        {
+            const CImg<> &frame = (*sequence.second)[i];
+            FrameStats stats;
+            last = NextFrame(state, frame, stats);
+            auto t0 = std::chrono::steady_clock::now();
+            Superpixels full = SLIC(frame, {20, m, 100, 0.25f, nbThreads});
+            double fullMs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() * 1000;
+            if (i == 0)
+            {
+                std::cout << sequence.first << ", first frame: " << stats.ms << " ms, " << stats.iterations
+                          << " iterations" << std::endl;
+                continue;
+            }
+            streamTotal += stats.ms;
+            streamMax = std::max(streamMax, stats.ms);
+            fullTotal += fullMs;
+            dirtyTotal += stats.dirtyCells;
+            iterationsTotal += stats.iterations;
+            nbOverBudget += stats.overBudget;
+        }
+        std::cout << sequence.first << ", next " << n - 1 << " frames: " << streamTotal / (n - 1) << " ms per frame (max "
+                  << streamMax << " ms, " << nbOverBudget << " over the " << state.budget << " ms budget), "
+                  << (float)iterationsTotal / (n - 1) << " iterations, "
+                  << 100 * dirtyTotal / (n - 1) << "% of the cells assigned again (from scratch: "
+                  << fullTotal / (n - 1) << " ms per frame)" << std::endl;
+        if (sequence.second == &sliding)
+            DrawBoundaries(last).save_png("./results/slic_streaming.png");
+    }
+
+    return 0;
+}
@@ -0,0 +1,402 @@
+/*
+    Marker-controlled watershed
+
+    The markers are flooded in increasing order of the gradient (Meyer's
+    algorithm): a pixel pops out of the queue, and gives its label to its
+    unlabeled 4-neighbors, which enter the queue with the priority of their
+    gradient (or of the current level, if it is higher).
+    - For 8-bit and 16-bit gradients, the queue is a hierarchical queue: one
+      FIFO per gray level, and a current level that never decreases. Each
+      pixel enters the queue once, so the flooding is in O(N + L) for L
+      levels.
+    - For float gradients, the queue is a heap, ordered by level, then by
+      the number of steps taken at that level, as the FIFOs.
+    - A pixel takes the label of its parent, the neighbor that floods it
+      first (the first in a fixed order on ties), so that the result does not
+      depend on the order of the queue.
+    - Optionally, the image is cut into strips of rows, flooded
+      independently in parallel from the markers they contain. The rows
+      around each seam are then flooded again over the whole image: only the
+      pixels reached earlier through the seams, and those whose parent
+      changes label, are visited, which gives the result of a single
+      flooding.
+*/
+
+#define cimg_use_png
+#include "CImg.h"
+
+#include <queue>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+using namespace cimg_library;
+
+/*
+  Flooding order of a pixel of gradient g reached from a pixel flooded at
+  (level, round): the level is the highest gradient on the path, and the
+  round counts the steps taken at that level (the markers are at round 0, a
+  pixel that raises the level is at round 1).
+*/
+template <typename T>
+inline void NextOrder(T level, unsigned int round, T g, T &nextLevel, unsigned int &nextRound)
+{
+    nextLevel = std::max(level, g);
+    nextRound = g > level ? 1 : round + 1;
+}
+
+/*
+  Visit of a pixel i popped from the queue. Its label is the one of its
+  parent: among the neighbors that reach it at its level and round, the one
+  flooded first, then the first in the order left, right, up, down. The
+  result does not depend on the order of the queue, so the strips can be
+  corrected afterwards to the exact result of a single flooding. Then the
+  neighbors reached earlier than they currently are (or not yet flooded) are
+  updated and pushed.
+  When correcting (dirty != 0), only the dirty pixels are visited: 1 for a
+  pixel reached earlier (or a seed), 2 for a pixel whose parent may have
+  changed. The neighbors that i may be the parent of are marked 2 if i is
+  reached earlier or changes label.
+*/
+template <typename T, typename Push>
+inline void Visit(int i, int w, int first, int last, const T *G, int *L, T *lv, unsigned int *rd,
+                  unsigned char *dirty, Push push)
+{
+    if (dirty && !dirty[i])
+        return;
+    int x = i % w, label = L[i];
+    int neighbors[4] = {x > 0 ? i - 1 : -1, x < w - 1 ? i + 1 : -1, i - w >= first ? i - w : -1,
+                        i + w < last ? i + w : -1};
+    T level;
+    unsigned int round;
+    if (rd[i])
+    {
+        int parent = -1;
+        for (int j : neighbors)
+            if (j >= 0 && L[j] && (parent < 0 || lv[j] < lv[parent] || (lv[j] == lv[parent] && rd[j] < rd[parent])))
+            {
+                NextOrder(lv[j], rd[j], G[i], level, round);
+                if (level == lv[i] && round == rd[i])
+                    parent = j;
+            }
+        L[i] = L[parent];
+    }
+    bool changed = !dirty || dirty[i] == 1 || L[i] != label;
+    if (dirty)
+        dirty[i] = 0;
+    if (!changed)
+        return;
+    for (int j : neighbors)
+        if (j >= 0 && (!L[j] || dirty))
+        {
+            // In a flooding, the pixels are popped in order, and a labeled
+            // pixel cannot be reached earlier.
+            NextOrder(lv[i], rd[i], G[j], level, round);
+            if (!L[j] || level < lv[j] || (level == lv[j] && round < rd[j]))
+            {
+                L[j] = L[i];
+                lv[j] = level;
+                rd[j] = round;
+                if (dirty)
+                    dirty[j] = 1;
+                push(j);
+            }
+            else if (dirty && !dirty[j] && level == lv[j] && round == rd[j])
+            {
+                dirty[j] = 2;
+                push(j);
+            }
+        }
+}
+
+/*
+  Flooding of the rows [y0, y1) with a hierarchical queue, from the seeds.
+  Each level is a FIFO stored in a vector, so that the pixels are appended
+  and read back contiguously, and is released once flooded. The seeds of a
+  level that are not markers are popped in the order of their round, merged
+  with its FIFO.
+  Pixels are only labeled within the rows.
+  gradient : Gradient image, with values in [0, nbLevels)
+  labels   : Labels (0 for unlabeled), updated
+  levels   : Flooding levels of the labeled pixels, updated
+  rounds   : Flooding rounds of the labeled pixels, updated
+  y0, y1   : Rows to flood
+  seeds    : Labeled pixels of the rows from which the flooding starts
+  dirty    : Pixels to visit when correcting a flooding (0 for a flooding)
+  nbLevels : Number of levels
+*/
+template <typename T>
+void FloodBuckets(const CImg<T> &gradient, CImg<int> &labels, CImg<T> &levels, CImg<unsigned int> &rounds, int y0,
+                  int y1, const std::vector<int> &seeds, unsigned char *dirty, int nbLevels)
+{
+    int w = gradient.width(), first = y0 * w, last = y1 * w;
+    const T *G = gradient.data();
+    int *L = labels.data();
+    T *lv = levels.data();
+    unsigned int *rd = rounds.data();
+    std::vector<std::vector<int>> queue(nbLevels);
+    std::vector<std::vector<std::pair<unsigned int, int>>> seedQueue(nbLevels);
+    auto push = [&](int j) { queue[lv[j]].push_back(j); };
+    for (int i : seeds)
+        if (rd[i])
+            seedQueue[lv[i]].push_back({rd[i], i});
+        else
+            push(i); // Markers, flooded first at their level
+
+    for (int level = 0; level < nbLevels; ++level)
+    {
+        std::vector<int> &fifo = queue[level];
+        std::vector<std::pair<unsigned int, int>> &sorted = seedQueue[level];
+        if (!std::is_sorted(sorted.begin(), sorted.end()))
+            std::sort(sorted.begin(), sorted.end());
+        size_t k = 0, s = 0;
+        for (;;)
+        {
+            // When correcting, the pixels flooded earlier since they were
+            // queued are skipped.
+            while (dirty && k < fifo.size() && lv[fifo[k]] != level)
+                ++k;
+            while (dirty && s < sorted.size() &&
+                   (lv[sorted[s].second] != level || rd[sorted[s].second] != sorted[s].first))
+                ++s;
+            if (k == fifo.size() && s == sorted.size())
+                break;
+            int i = s < sorted.size() && (k == fifo.size() || sorted[s].first <= rd[fifo[k]]) ? sorted[s++].second
+                                                                                             : fifo[k++];
+            Visit(i, w, first, last, G, L, lv, rd, dirty, push);
+        }
+        std::vector<int>().swap(fifo);
+        std::vector<std::pair<unsigned int, int>>().swap(sorted);
+    }
+}
+
+void Flood(const CImg<unsigned char> &gradient, CImg<int> &labels, CImg<unsigned char> &levels,
+           CImg<unsigned int> &rounds, int y0, int y1, const std::vector<int> &seeds, unsigned char *dirty = 0)
+{
+    FloodBuckets(gradient, labels, levels, rounds, y0, y1, seeds, dirty, 256);
+}
+
+void Flood(const CImg<unsigned short> &gradient, CImg<int> &labels, CImg<unsigned short> &levels,
+           CImg<unsigned int> &rounds, int y0, int y1, const std::vector<int> &seeds, unsigned char *dirty = 0)
+{
+    FloodBuckets(gradient, labels, levels, rounds, y0, y1, seeds, dirty, 65536);
+}
+
+/*
+  Flooding of the rows [y0, y1) with a heap ordered by level and round, for
+  float gradients (same parameters as FloodBuckets).
+*/
+void Flood(const CImg<> &gradient, CImg<int> &labels, CImg<> &levels, CImg<unsigned int> &rounds, int y0, int y1,
+           const std::vector<int> &seeds, unsigned char *dirty = 0)
+{
+    struct Item
+    {
+        float level;
+        unsigned int round;
+        int i;
+        bool operator<(const Item &other) const
+        {
+            return level > other.level || (level == other.level && round > other.round);
+        }
+    };
+    int w = gradient.width(), first = y0 * w, last = y1 * w;
+    const float *G = gradient.data();
+    int *L = labels.data();
+    float *lv = levels.data();
+    unsigned int *rd = rounds.data();
+    std::priority_queue<Item> heap;
+    for (int i : seeds)
+        heap.push({lv[i], rd[i], i});
+    auto push = [&](int j) { heap.push({lv[j], rd[j], j}); };
+    while (!heap.empty())
+    {
+        Item item = heap.top();
+        heap.pop();
+        // Pixels flooded earlier since they were queued are skipped.
+        if (item.level == lv[item.i] && item.round == rd[item.i])
+            Visit(item.i, w, first, last, G, L, lv, rd, dirty, push);
+    }
+}
+
+/*
+  Marker-controlled watershed. Every pixel connected to a marker gets the
+  label of the basin that floods it first.
+  gradient  : Gradient image (unsigned char, unsigned short or float)
+  markers   : Markers (labels > 0, 0 elsewhere)
+  nbStrips  : Number of strips flooded independently (1 for a single flooding)
+  nbThreads : Number of threads for the strips
+*/
+template <typename T>
+CImg<int> Watershed(const CImg<T> &gradient, const CImg<int> &markers, int nbStrips = 1, unsigned int nbThreads = 1)
+{
+    int w = gradient.width(), h = gradient.height();
+    nbStrips = std::max(1, std::min(nbStrips, h));
+    CImg<int> labels(markers);
+    CImg<T> levels(w, h);
+    CImg<unsigned int> rounds(w, h);
+    cimg_foroff(markers, i) if (markers[i])
+    {
+        levels[i] = gradient[i];
+        rounds[i] = 0;
+    }
+
+    // Flooding of each strip from its markers.
+    std::vector<int> first(nbStrips + 1);
+    for (int s = 0; s <= nbStrips; ++s)
+        first[s] = (int)((long long)h * s / nbStrips);
+    auto flood = [&, w](int s0, int s1)
+    {
+        for (int s = s0; s < s1; ++s)
+        {
+            std::vector<int> seeds;
+            for (int i = first[s] * w; i < first[s + 1] * w; ++i)
+                if (labels[i])
+                    seeds.push_back(i);
+            Flood(gradient, labels, levels, rounds, first[s], first[s + 1], seeds);
+        }
+    };
+    nbThreads = std::max(1u, std::min(nbThreads, (unsigned int)nbStrips));
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(flood, nbStrips * t / nbThreads, nbStrips * (t + 1) / nbThreads);
+    for (auto &wk : workers)
+        wk.join();
+    if (nbStrips == 1)
+        return labels;
+
+    // Seams: a strip only saw the paths inside it, so its pixels are flooded
+    // at most as early as in a single flooding. The rows on both sides of each
+    // seam are flooded again over the whole image, from their current order:
+    // only the pixels reached earlier, or whose parent changes label, are
+    // visited again, until the result is the one of a single flooding. A
+    // strip without any marker is flooded from the seams.
+    std::vector<int> seeds;
+    std::vector<unsigned char> dirty(labels.size(), 0);
+    for (int s = 1; s < nbStrips; ++s)
+        for (int y = first[s] - 1; y <= first[s]; ++y)
+            for (int x = 0; x < w; ++x)
+                if (labels(x, y))
+                {
+                    seeds.push_back(y * w + x);
+                    dirty[y * w + x] = 1;
+                }
+    Flood(gradient, labels, levels, rounds, 0, h, seeds, dirty.data());
+    return labels;
+}
+
+/*
+  Percentage of the pixels with different labels.
+*/
+float Difference(const CImg<int> &labels, const CImg<int> &reference)
+{
+    size_t different = 0;
+    cimg_foroff(labels, i) different += labels[i] != reference[i];
+    return 100.0f * different / labels.size();
+}
+
+/*
+  Beucher gradient (3x3), as in morphological_gradient.cpp, and the markers:
+  the coins closed and eroded (one label per coin), and the background far
+  from them.
+  gray     : Gray-level image of the coins
+  gradient : Output, Beucher gradient in [0, 255]
+  markers  : Output, markers
+*/
+void CoinsGradientAndMarkers(const CImg<> &gray, CImg<> &gradient, CImg<int> &markers)
+{
+    CImg<> B = CImg<>(3, 3).fill(1);
+    gradient = gray.get_dilate(B) - gray.get_erode(B);
+    gradient.normalize(0, 255);
+
+    CImg<unsigned char> mask = gray.get_threshold(gray.median() + 30).blur_median(3.0f);
+    mask.dilate(15, 15).erode(15, 15);
+    CImg<unsigned char> inside = mask.get_erode(21, 21), outside = mask.get_dilate(15, 15);
+    CImg<unsigned int> coins = inside.get_label(true);
+    markers.assign(gray.width(), gray.height(), 1, 1, 0);
+    // Small components come from the noise of the background.
+    std::vector<int> area(coins.max() + 1, 0), index(coins.max() + 1, 0);
+    cimg_forXY(markers, x, y) if (inside(x, y)) ++area[coins(x, y)];
+    int nbCoins = 0;
+    cimg_forXY(markers, x, y) if (inside(x, y) && area[coins(x, y)] >= 500)
+    {
+        if (!index[coins(x, y)])
+            index[coins(x, y)] = ++nbCoins;
+        markers(x, y) = index[coins(x, y)];
+    }
+    cimg_forXY(markers, x, y) if (!outside(x, y)) markers(x, y) = nbCoins + 1;
+}
+
+int main()
+{
+    unsigned int nbThreads = std::max(1u, std::thread::hardware_concurrency());
+    CImg<> gray("../images/coins.png");
+    gray.norm().blur(1.0f);
+    CImg<> gradient;
+    CImg<int> markers;
+    CoinsGradientAndMarkers(gray, gradient, markers);
+
+    // Comparison of the queues, the strips and CImg::watershed(), which floods
+    // the highest priorities first (hence the negated gradient), and gives a
+    // pixel the label of the nearest seed among its neighbors.
+    CImg<unsigned char> gradient8 = gradient.get_round();
+    CImg<unsigned short> gradient16 = CImg<unsigned short>(gradient8) * 257;
+    CImg<int>
+        labels8 = Watershed(gradient8, markers),
+        labels16 = Watershed(gradient16, markers),
+        labelsFloat = Watershed(CImg<>(gradient8), markers),
+        labelsStrips = Watershed(gradient8, markers, 4, nbThreads),
+        labelsCImg = markers.get_watershed(-CImg<>(gradient8));
+    // The queues and the strips flood the same levels in the same order.
+    if (labels16 != labels8 || labelsFloat != labels8 || labelsStrips != labels8)
+    {
+        std::cerr << "Coins: the 16-bit queue, the float heap or the strips differ from the 8-bit queue." << std::endl;
+        return 1;
+    }
+    std::cout << "Coins (" << markers.max() << " basins): 16-bit queue, float heap and 4 strips identical to the "
+              << "8-bit queue, CImg::watershed() differs on " << Difference(labelsCImg, labels8) << "% of the pixels"
+              << std::endl;
+
+    CImg<unsigned char> visu = gray.get_normalize(0, 255).resize(-100, -100, 1, 3);
+    unsigned char red[] = {255, 0, 0};
+    cimg_forXY(labels8, x, y) if ((x < labels8.width() - 1 && labels8(x, y) != labels8(x + 1, y)) ||
+                                  (y < labels8.height() - 1 && labels8(x, y) != labels8(x, y + 1)))
+        visu.draw_point(x, y, red);
+    visu.save_png("./results/watershed.png");
+
+    // Benchmark at 50 MP.
+    int W = 8660, H = 5770;
+    double mp = (double)W * H / 1e6;
+    CImg<> large = gradient.get_resize(W, H, 1, 1, 3);
+    CImg<int> largeMarkers = markers.get_resize(W, H, 1, 1, 1);
+    CImg<unsigned char> large8 = large.get_round();
+    CImg<unsigned short> large16 = (large * 257).round();
+    auto run = [&](const std::string &name, std::function<CImg<int>()> f, const CImg<int> *reference)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        CImg<int> labels = f();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        std::cout << name << ": " << seconds * 1000 << " ms, " << mp / seconds << " MP/s";
+        if (reference)
+            std::cout << ", difference " << Difference(labels, *reference) << "%";
+        std::cout << std::endl;
+        return labels;
+    };
+    std::cout << W << "x" << H << ":" << std::endl;
+    CImg<int> reference = run("  8-bit hierarchical queue", [&]() { return Watershed(large8, largeMarkers); }, 0);
+    run("  16-bit hierarchical queue", [&]() { return Watershed(large16, largeMarkers); }, &reference);
+    run("  float heap", [&]() { return Watershed(large, largeMarkers); }, &reference);
+    CImg<int> strips = run("  8-bit, 16 strips (" + std::to_string(nbThreads) + " threads)",
+                           [&]() { return Watershed(large8, largeMarkers, 16, nbThreads); }, &reference);
+    if (strips != reference)
+    {
+        std::cerr << "The strips differ from the single flooding." << std::endl;
+        return 1;
+    }
+    run("  CImg::watershed()", [&]() { return largeMarkers.get_watershed(-CImg<>(large8)); }, &reference);
+
+    return 0;
+}
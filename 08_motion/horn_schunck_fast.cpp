@@ -0,0 +1,353 @@
+/*
+    Horn-Schunck optical flow method, with red-black SOR
+
+    horn_schunck.cpp convolves the whole displacement field with the
+    averaging kernel at each iteration (a new 2-channel image), then updates
+    the pixels through accessors, and the Jacobi iterations need hundreds of
+    sweeps to converge. Here:
+    - The pixels are split into red ((x + y) even) and black pixels, and each
+      row is stored as two compact arrays, one per color. The 4 neighbors of
+      a red pixel are black, so a sweep over the red pixels reads the black
+      arrays at unit stride, and updates the red arrays in place: the
+      averaging and the update are a single stencil, which vectorizes.
+    - Updating the red pixels from the black ones, then the black pixels from
+      the new red ones, is a Gauss-Seidel iteration. It is over-relaxed
+      (SOR): the new value is moved further by a factor omega in (1, 2).
+    - The rows of a color are split into bands processed by several threads.
+    - The iterations stop when the mean update of a sweep falls below a
+      tolerance.
+*/
+
+#define cimg_use_png
+#include "CImg.h"
+
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+using namespace cimg_library;
+
+/*
+    Runs f(first, last, t) on nbThreads ranges splitting [0, n)
+*/
+template <typename F>
+void ParallelFor(int n, unsigned int nbThreads, F f)
+{
+    nbThreads = std::max(1u, std::min(nbThreads, (unsigned int)std::max(n, 1)));
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < nbThreads; ++t)
+        workers.emplace_back(f, (int)((long long)n * t / nbThreads), (int)((long long)n * (t + 1) / nbThreads), t);
+    for (auto &wk : workers)
+        wk.join();
+}
+
+// Parameters of the solver.
+struct HornSchunckParams
+{
+    float alpha;            // Regularization weight for the displacement field
+    float omega;            // Over-relaxation factor (1 for Gauss-Seidel)
+    int maxIterations;      // Maximal number of iterations (red and black sweeps)
+    float tolerance;        // Mean update of u and v below which the iterations stop
+    unsigned int nbThreads; // Number of threads
+};
+
+/*
+    Image split by colors: pixel (x, y) has color c = (x + y) % 2, and is
+    element k = x / 2 of row y in plane c.
+*/
+struct RedBlack
+{
+    int w, h, hw;
+    CImg<> planes[2];
+
+    RedBlack(int w, int h) : w(w), h(h), hw((w + 1) / 2)
+    {
+        planes[0].assign(hw, h, 1, 1, 0);
+        planes[1].assign(hw, h, 1, 1, 0);
+    }
+
+    RedBlack(const CImg<> &img, int channel) : RedBlack(img.width(), img.height())
+    {
+        cimg_forXY(img, x, y) planes[(x + y) & 1](x / 2, y) = img(x, y, 0, channel);
+    }
+
+    float &operator()(int x, int y) { return planes[(x + y) & 1](x / 2, y); }
+
+    void unpack(CImg<> &img, int channel) const
+    {
+        cimg_forXY(img, x, y) img(x, y, 0, channel) = planes[(x + y) & 1](x / 2, y);
+    }
+};
+
+/*
+    Gradients of the sequence, as in horn_schunck.cpp: spatial gradients of
+    the first image, and forward difference in time.
+    seq        : Sequence of two images, stacked along z
+    Ix, Iy, It : Output, gradients
+*/
+void Gradients(const CImg<> &seq, CImg<> &Ix, CImg<> &Iy, CImg<> &It)
+{
+    CImgList<> gradients = (seq.get_slice(0).get_gradient("xy"), seq.get_gradient("z", 1));
+    Ix = gradients[0];
+    Iy = gradients[1];
+    It = gradients[2].get_slice(0);
+}
+
+/*
+    Mean size of the Jacobi update |u' - u| + |v' - v| of a displacement
+    field, i.e. the residual of the linear system scaled by the inverse of
+    its diagonal. This is the common measure of convergence of the solvers.
+    V          : Displacement field
+    Ix, Iy, It : Gradients
+    alpha      : Regularization weight
+*/
+double Residual(const CImg<> &V, const CImg<> &Ix, const CImg<> &Iy, const CImg<> &It, float alpha)
+{
+    int w = V.width(), h = V.height();
+    double sum = 0;
+    cimg_forXY(V, x, y)
+    {
+        int
+            xm = std::max(x - 1, 0), xp = std::min(x + 1, w - 1),
+            ym = std::max(y - 1, 0), yp = std::min(y + 1, h - 1);
+        float
+            ub = 0.25f * (V(xm, y, 0) + V(xp, y, 0) + V(x, ym, 0) + V(x, yp, 0)),
+            vb = 0.25f * (V(xm, y, 1) + V(xp, y, 1) + V(x, ym, 1) + V(x, yp, 1)),
+            t = (Ix(x, y) * ub + Iy(x, y) * vb + It(x, y)) / (Ix(x, y) * Ix(x, y) + Iy(x, y) * Iy(x, y) + 4 * alpha);
+        sum += std::abs(ub - Ix(x, y) * t - V(x, y, 0)) + std::abs(vb - Iy(x, y) * t - V(x, y, 1));
+    }
+    return sum / (w * h);
+}
+
+/*
+    Update of the pixels [k0, k1] of a row of one color, which have both
+    horizontal neighbors in the image, and rows above and below (so that
+    no array is written and read at once: the pointers are restricted,
+    which lets the loop vectorize).
+    p          : Offset of the row (pixel k is at x = 2k + p)
+    omega      : Over-relaxation factor
+    U, V       : Flow of the row, updated
+    R          : Output, |du| + |dv| of each pixel
+    UL, VL     : Flow of the other color in the row
+    UA, VA     : Flow of the other color in the row above
+    UB, VB     : Flow of the other color in the row below
+    A, B, T, D : Ix, Iy, It and 1 / (Ix^2 + Iy^2 + 4 alpha) of the row
+*/
+void SweepRow(int k0, int k1, int p, float omega, float *__restrict U, float *__restrict V, float *__restrict R,
+              const float *__restrict UL, const float *__restrict VL, const float *__restrict UA,
+              const float *__restrict VA, const float *__restrict UB, const float *__restrict VB,
+              const float *__restrict A, const float *__restrict B, const float *__restrict T,
+              const float *__restrict D)
+{
+    for (int k = k0; k <= k1; ++k)
+    {
+        float
+            ub = 0.25f * (UL[k + p - 1] + UL[k + p] + UA[k] + UB[k]),
+            vb = 0.25f * (VL[k + p - 1] + VL[k + p] + VA[k] + VB[k]),
+            t = (A[k] * ub + B[k] * vb + T[k]) * D[k],
+            du = omega * (ub - A[k] * t - U[k]),
+            dv = omega * (vb - B[k] * t - V[k]);
+        U[k] += du;
+        V[k] += dv;
+        R[k] = std::abs(du) + std::abs(dv);
+    }
+}
+
+/*
+    Horn and Schunck method, solved by red-black SOR. Returns the number of
+    iterations (one iteration is a red and a black sweep).
+    V          : Displacement field (initial value), updated
+    Ix, Iy, It : Gradients
+    params     : Parameters of the solver
+*/
+int HornSchunckSOR(CImg<> &V, const CImg<> &Ix, const CImg<> &Iy, const CImg<> &It, const HornSchunckParams &params)
+{
+    int w = V.width(), h = V.height();
+    RedBlack u(V, 0), v(V, 1), gx(Ix, 0), gy(Iy, 0), gt(It, 0), inv(w, h);
+    cimg_forXY(Ix, x, y) inv(x, y) = 1 / (Ix(x, y) * Ix(x, y) + Iy(x, y) * Iy(x, y) + 4 * params.alpha);
+    float omega = params.omega;
+    std::vector<double> partial(std::max(1u, params.nbThreads));
+
+    // Sweep over the pixels of color c of the rows [y0, y1), and sum of the
+    // updates.
+    auto sweep = [&, w, h, omega](int c, int y0, int y1)
+    {
+        double sum = 0;
+        std::vector<float> updates(u.hw);
+        float *R = updates.data();
+        for (int y = y0; y < y1; ++y)
+        {
+            int
+                p = (y + c) & 1,             // Pixel k of the row is at x = 2k + p
+                n = (w - p + 1) / 2,         // Number of pixels of color c in the row
+                ya = y > 0 ? y - 1 : y,      // Neumann boundaries, as get_convolve
+                yb = y < h - 1 ? y + 1 : y;
+            float
+                *U = u.planes[c].data(0, y), *Vv = v.planes[c].data(0, y);
+            const float
+                *A = gx.planes[c].data(0, y), *B = gy.planes[c].data(0, y), *T = gt.planes[c].data(0, y),
+                *D = inv.planes[c].data(0, y),
+                // Neighbors of the other color: in the same row at k + p - 1 and
+                // k + p, and at k in the rows above and below. At the top and
+                // bottom rows, the neighbor is the pixel itself (same color).
+                *UL = u.planes[1 - c].data(0, y), *VL = v.planes[1 - c].data(0, y),
+                *UA = u.planes[ya == y ? c : 1 - c].data(0, ya), *VA = v.planes[ya == y ? c : 1 - c].data(0, ya),
+                *UB = u.planes[yb == y ? c : 1 - c].data(0, yb), *VB = v.planes[yb == y ? c : 1 - c].data(0, yb);
+            auto update = [&](int k, float ul, float ur, float vl, float vr)
+            {
+                float
+                    ub = 0.25f * (ul + ur + UA[k] + UB[k]),
+                    vb = 0.25f * (vl + vr + VA[k] + VB[k]),
+                    t = (A[k] * ub + B[k] * vb + T[k]) * D[k],
+                    du = omega * (ub - A[k] * t - U[k]),
+                    dv = omega * (vb - B[k] * t - Vv[k]);
+                U[k] += du;
+                Vv[k] += dv;
+                return std::abs(du) + std::abs(dv);
+            };
+            // Pixels with both horizontal neighbors in the image, then the
+            // first and last pixels of the row.
+            int k0 = p ? 0 : 1, k1 = w - 2 - p >= 0 ? (w - 2 - p) / 2 : -1;
+            if (ya != y && yb != y)
+                SweepRow(k0, k1, p, omega, U, Vv, R, UL, VL, UA, VA, UB, VB, A, B, T, D);
+            else
+                for (int k = k0; k <= k1; ++k)
+                    R[k] = update(k, UL[k + p - 1], UL[k + p], VL[k + p - 1], VL[k + p]);
+            // Sum of the updates in 8 independent lanes, so that the loops
+            // above and below vectorize without reordering the float sums.
+            float lanes[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+            int k = k0;
+            for (; k + 8 <= k1 + 1; k += 8)
+                for (int l = 0; l < 8; ++l)
+                    lanes[l] += R[k + l];
+            for (; k <= k1; ++k)
+                lanes[0] += R[k];
+            for (int l = 0; l < 8; ++l)
+                sum += lanes[l];
+            // First and last pixels (a single one if n == 1, none if n == 0).
+            int borders[2] = {0, n - 1}, nbBorders = std::min(n, 2);
+            for (int b = 0; b < nbBorders; ++b)
+            {
+                int k = borders[b];
+                if (k >= k0 && k <= k1)
+                    continue;
+                int x = 2 * k + p;
+                float
+                    ul = x > 0 ? UL[k + p - 1] : U[k], ur = x < w - 1 ? UL[k + p] : U[k],
+                    vl = x > 0 ? VL[k + p - 1] : Vv[k], vr = x < w - 1 ? VL[k + p] : Vv[k];
+                sum += update(k, ul, ur, vl, vr);
+            }
+        }
+        return sum;
+    };
+
+    int iterations = 0;
+    while (iterations < params.maxIterations)
+    {
+        ++iterations;
+        double total = 0;
+        for (int c = 0; c < 2; ++c)
+        {
+            ParallelFor(h, params.nbThreads, [&, c](int y0, int y1, unsigned int t) { partial[t] = sweep(c, y0, y1); });
+            for (unsigned int t = 0; t < partial.size() && t < (unsigned int)h; ++t)
+                total += partial[t];
+        }
+        if (total / ((double)w * h) < params.tolerance)
+            break;
+    }
+    u.unpack(V, 0);
+    v.unpack(V, 1);
+    return iterations;
+}
+
+/*
+    Reference implementation, copied from horn_schunck.cpp for the benchmark.
+*/
+void HornSchunck(CImg<> &displacementField,
+                 CImg<> &imageSequence,
+                 unsigned int numIterations,
+                 float regularizationAlpha)
+{
+    CImgList<> gradients = (imageSequence.get_slice(0).get_gradient("xy"), imageSequence.get_gradient("z", 1));
+    CImg<> avgKernel(3, 3, 1, 1,
+                     0., 0.25, 0.,
+                     0.25, 0., 0.25,
+                     0., 0.25, 0.);
+    CImg<> denom = gradients[0].get_sqr() + gradients[1].get_sqr() + 4 * regularizationAlpha;
+
+    for (unsigned int iter = 0; iter < numIterations; ++iter)
+    {
+        CImg<> averagedField = displacementField.get_convolve(avgKernel);
+
+        cimg_forXY(displacementField, x, y)
+        {
+            float tempTerm = (gradients[0](x, y) * averagedField(x, y, 0) + gradients[1](x, y) * averagedField(x, y, 1) + gradients[2](x, y)) / denom(x, y);
+            displacementField(x, y, 0) = averagedField(x, y, 0) - gradients[0](x, y) * tempTerm;
+            displacementField(x, y, 1) = averagedField(x, y, 1) - gradients[1](x, y) * tempTerm;
+        }
+    }
+}
+
+int main()
+{
+    unsigned int nbThreads = std::max(1u, std::thread::hardware_concurrency());
+    CImg<>
+        img1("../images/driveby_1.png"),
+        img2("../images/driveby_2.png");
+
+    img1.norm().blur(1.0f);
+    img2.norm().blur(1.0f).resize(img1);
+    float alpha = 0.1f;
+
+    for (int scale = 1; scale <= 4; scale *= 4)
+    {
+        // Sequence of two images, stacked along z
+        CImg<> seq(img1.width() * scale, img1.height() * scale, 2, 1, 0.);
+        seq.draw_image(0, 0, 0, 0, img1.get_resize(seq.width(), seq.height(), 1, 1, 3));
+        seq.draw_image(0, 0, 1, 0, img2.get_resize(seq.width(), seq.height(), 1, 1, 3));
+        CImg<> Ix, Iy, It;
+        Gradients(seq, Ix, Iy, It);
+
+        // Jacobi iterations of horn_schunck.cpp, and the residual they reach.
+        int jacobiIterations = scale == 1 ? 1000 : 200;
+        CImg<> reference(seq.width(), seq.height(), 1, 2, 0.);
+        auto t0 = std::chrono::steady_clock::now();
+        HornSchunck(reference, seq, jacobiIterations, alpha);
+        double ms = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() * 1000;
+        double referenceResidual = Residual(reference, Ix, Iy, It, alpha);
+        std::cout << seq.width() << "x" << seq.height() << ", horn_schunck.cpp: " << jacobiIterations
+                  << " iterations, " << ms << " ms, residual " << referenceResidual << std::endl;
+
+        // Gauss-Seidel and SOR, down to the same residual. The tolerance on the
+        // mean update that reaches it is found by halving the tolerance.
+        for (float omega : {1.0f, 1.9f})
+        {
+            CImg<> V(seq.width(), seq.height(), 1, 2, 0.);
+            HornSchunckParams params = {alpha, omega, 10000, 1, nbThreads};
+            int iterations = 0;
+            double residual = 0;
+            for (; params.tolerance > 1e-8f; params.tolerance /= 2)
+            {
+                V.fill(0);
+                t0 = std::chrono::steady_clock::now();
+                iterations = HornSchunckSOR(V, Ix, Iy, It, params);
+                ms = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() * 1000;
+                residual = Residual(V, Ix, Iy, It, alpha);
+                if (residual <= referenceResidual)
+                    break;
+            }
+            std::cout << "  red-black " << (omega == 1 ? "Gauss-Seidel" : "SOR (omega = 1.9)") << ": " << iterations
+                      << " iterations, " << ms << " ms (" << nbThreads << " threads), residual " << residual
+                      << " (tolerance " << params.tolerance << "), mean difference with horn_schunck.cpp "
+                      << (V - reference).abs().mean() << std::endl;
+            if (scale == 1 && omega > 1)
+                V.get_norm().normalize(0, 255).save_png("./results/horn_schunck_fast.png");
+        }
+    }
+
+    return 0;
+}